@@ -1,18 +1,16 @@
 #include "adr_stack.h"
 
-void adr_push(AdrStack *self, u16 adr) {
-   if (self->head == MAX_ADR_STACK) {
-      printf("Failed to push, full!\n");
-      exit(0);
-   }
+bool adr_push(AdrStack *self, u16 adr) {
+   if (self->head == MAX_ADR_STACK)
+      return false;
    self->addresses[self->head++] = adr;
+   return true;
 }
 
-u16 adr_pop(AdrStack *self) {
-   if (self->head <= 0) {
-      printf("Failed to pop, no elements!\n");
-      exit(0);
-   }
+bool adr_pop(AdrStack *self, u16 *out_adr) {
+   if (self->head <= 0)
+      return false;
 
-   return self->addresses[--self->head];
+   *out_adr = self->addresses[--self->head];
+   return true;
 }
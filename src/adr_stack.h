@@ -9,7 +9,7 @@ typedef struct AdrStack {
    s16 head;
 } AdrStack;
 
-void adr_push(AdrStack *self, u16 adr);
-u16 adr_pop(AdrStack *self);
+bool adr_push(AdrStack *self, u16 adr);     // false when full
+bool adr_pop(AdrStack *self, u16 *out_adr); // false when empty
 
 #endif
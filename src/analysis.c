@@ -0,0 +1,683 @@
+#include "analysis.h"
+#include "quirks.h"
+
+#define DATA_PER_LINE 8
+#define NO_CONST UINT16_MAX
+#define I_UNSET (UINT16_MAX - 1) // no way into the block seen yet
+#define SEEN_BODY 1
+#define SEEN_CALLEE 2
+
+static const char *EDGE_KINDS[] = {"fall", "jump", "skip", "call", "indirect"};
+
+// addresses still to decode, each queued once
+typedef struct Worklist {
+   u16 items[RAM_SIZE];
+   u32 count;
+   bool queued[RAM_SIZE];
+} Worklist;
+
+static u16 instr_at(const u8 *ram, u16 adr);
+static bool is_control(u16 instr);
+static bool is_valid(u16 instr);
+static void push(Worklist *work, u32 adr);
+static void explore(Analysis *an, const u8 *ram, Worklist *work);
+static void add_edge(Analysis *an, u16 from, u16 to, AnEdgeKind kind, Worklist *work);
+static u16 const_before(const Analysis *an, const u8 *ram, u16 adr, u8 reg);
+static void resolve_indirect(Analysis *an, const u8 *ram, u16 adr, Worklist *work);
+static void build_blocks(Analysis *an, const u8 *ram);
+static void classify_data(Analysis *an, const u8 *ram);
+static u16 follow_i(Analysis *an, const u8 *ram, const AnBlock *block, u16 I, bool classify);
+static void mark(Analysis *an, u16 adr, u16 len, u8 flag);
+static int compare_edges(const void *a, const void *b);
+static const AnEdge *edges_from(const Analysis *an, u16 adr, u32 *count);
+static u16 func_depth(Analysis *an, const u8 *ram, u16 entry, u8 *state);
+static const char *data_kind(u8 flags);
+static u16 data_run(const Analysis *an, u16 adr, u16 end);
+
+Analysis *analysis_run(const u8 *ram, u32 size) {
+   if (size > RAM_SIZE - PROGRAM_START_ADR)
+      return NULL;
+
+   Analysis *an = calloc(1, sizeof(*an));
+   Worklist *work = calloc(1, sizeof(*work));
+   if (!an || !work) {
+      printf("Failed to allocate the analysis\n");
+      free(an);
+      free(work);
+      return NULL;
+   }
+   an->end = PROGRAM_START_ADR + size;
+   an->FLAGS[PROGRAM_START_ADR] |= AN_LEADER | AN_FUNC;
+   push(work, PROGRAM_START_ADR);
+   explore(an, ram, work);
+   free(work);
+
+   build_blocks(an, ram);
+   classify_data(an, ram);
+
+   u8 *state = calloc(RAM_SIZE, 1);
+   an->max_depth = func_depth(an, ram, PROGRAM_START_ADR, state);
+   free(state);
+   return an;
+}
+
+void analysis_terminate(Analysis **an) {
+   free(*an);
+   *an = NULL;
+}
+
+bool analysis_is_code(const Analysis *an, u16 adr) {
+   return an->FLAGS[adr % RAM_SIZE] & (AN_CODE | AN_OPERAND);
+}
+
+u32 analysis_disasm(u16 instr, char *out, u32 len) {
+   const u16 X = (instr >> 8) & 0xF;
+   const u16 Y = (instr >> 4) & 0xF;
+   const u16 N = instr & 0xF;
+   const u16 NN = instr & 0xFF;
+   const u16 NNN = instr & 0xFFF;
+   static const char *ALU[] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN"};
+
+   switch (instr >> 12) {
+   case 0x0:
+      if (instr == 0x00E0)
+         return snprintf(out, len, "CLS");
+      if (instr == 0x00EE)
+         return snprintf(out, len, "RET");
+      return snprintf(out, len, "SYS 0x%03X", NNN);
+   case 0x1:
+      return snprintf(out, len, "JP 0x%03X", NNN);
+   case 0x2:
+      return snprintf(out, len, "CALL 0x%03X", NNN);
+   case 0x3:
+      return snprintf(out, len, "SE V%X, 0x%02X", X, NN);
+   case 0x4:
+      return snprintf(out, len, "SNE V%X, 0x%02X", X, NN);
+   case 0x5:
+      if (N == 0)
+         return snprintf(out, len, "SE V%X, V%X", X, Y);
+      break;
+   case 0x6:
+      return snprintf(out, len, "LD V%X, 0x%02X", X, NN);
+   case 0x7:
+      return snprintf(out, len, "ADD V%X, 0x%02X", X, NN);
+   case 0x8:
+      if (N < 8)
+         return snprintf(out, len, "%s V%X, V%X", ALU[N], X, Y);
+      if (N == 0xE)
+         return snprintf(out, len, "SHL V%X, V%X", X, Y);
+      break;
+   case 0x9:
+      if (N == 0)
+         return snprintf(out, len, "SNE V%X, V%X", X, Y);
+      break;
+   case 0xA:
+      return snprintf(out, len, "LD I, 0x%03X", NNN);
+   case 0xB:
+      return snprintf(out, len, "JP V0, 0x%03X", NNN);
+   case 0xC:
+      return snprintf(out, len, "RND V%X, 0x%02X", X, NN);
+   case 0xD:
+      return snprintf(out, len, "DRW V%X, V%X, %u", X, Y, N);
+   case 0xE:
+      if (NN == 0x9E)
+         return snprintf(out, len, "SKP V%X", X);
+      if (NN == 0xA1)
+         return snprintf(out, len, "SKNP V%X", X);
+      break;
+   case 0xF:
+      switch (NN) {
+      case 0x07:
+         return snprintf(out, len, "LD V%X, DT", X);
+      case 0x0A:
+         return snprintf(out, len, "LD V%X, K", X);
+      case 0x15:
+         return snprintf(out, len, "LD DT, V%X", X);
+      case 0x18:
+         return snprintf(out, len, "LD ST, V%X", X);
+      case 0x1E:
+         return snprintf(out, len, "ADD I, V%X", X);
+      case 0x29:
+         return snprintf(out, len, "LD F, V%X", X);
+      case 0x33:
+         return snprintf(out, len, "LD B, V%X", X);
+      case 0x55:
+         return snprintf(out, len, "LD [I], V%X", X);
+      case 0x65:
+         return snprintf(out, len, "LD V%X, [I]", X);
+      }
+      break;
+   }
+   return snprintf(out, len, "DW 0x%04X", instr);
+}
+
+s32 analysis_block_at(const Analysis *an, u16 adr) {
+   // blocks are sorted by start and do not overlap
+   s32 lo = 0;
+   s32 hi = an->num_blocks - 1;
+   while (lo <= hi) {
+      const s32 mid = (lo + hi) / 2;
+      if (adr < an->blocks[mid].start)
+         hi = mid - 1;
+      else if (adr >= an->blocks[mid].end)
+         lo = mid + 1;
+      else
+         return mid;
+   }
+   return -1;
+}
+
+void analysis_print(const Analysis *an, const u8 *ram, FILE *out) {
+   u32 instructions = 0;
+   u32 bytes[4] = {0}; // sprite, loaded, stored, unreferenced
+   char text[32];
+
+   for (u32 adr = PROGRAM_START_ADR; adr < RAM_SIZE;) {
+      const u8 flags = an->FLAGS[adr];
+      if (flags & AN_CODE) {
+         if (flags & (AN_LEADER | AN_FUNC))
+            fprintf(out, "%s_%03X:\n", flags & AN_FUNC ? "F" : "L", adr);
+         analysis_disasm(instr_at(ram, adr), text, sizeof(text));
+         fprintf(out, "   %03X  %04X  %s\n", adr, instr_at(ram, adr), text);
+         ++instructions;
+         adr += 2;
+         continue;
+      }
+      if (adr >= an->end) {
+         ++adr;
+         continue;
+      }
+
+      // a run of bytes of one kind, DATA_PER_LINE at a time
+      const u16 run = data_run(an, adr, an->end);
+      const char *kind = data_kind(flags);
+      for (u32 line = adr; line < adr + run; line += DATA_PER_LINE) {
+         const u32 stop = adr + run < line + DATA_PER_LINE ? adr + run : line + DATA_PER_LINE;
+         fprintf(out, "   %03X  ", line);
+         for (u32 i = line; i < stop; ++i)
+            fprintf(out, "%02X ", ram[i]);
+         fprintf(out, "%*s; %s\n", 3 * (s32)(line + DATA_PER_LINE - stop), "", kind);
+      }
+      bytes[flags & AN_SPRITE ? 0 : flags & AN_READ ? 1 : flags & AN_WRITE ? 2 : 3] += run;
+      adr += run;
+   }
+
+   fprintf(out, "; %u instructions, %u blocks, %u edges", instructions, an->num_blocks, an->num_edges);
+   if (an->dropped_edges)
+      fprintf(out, " (%u more dropped)", an->dropped_edges);
+   fprintf(out, "\n; %u data bytes: %u sprite, %u loaded, %u stored, %u unreferenced\n",
+           bytes[0] + bytes[1] + bytes[2] + bytes[3], bytes[0], bytes[1], bytes[2], bytes[3]);
+
+   u32 funcs = 0;
+   for (u32 adr = 0; adr < RAM_SIZE; ++adr)
+      funcs += (an->FLAGS[adr] & AN_FUNC) != 0;
+   if (an->max_depth == AN_DEPTH_UNBOUNDED)
+      fprintf(out, "; %u functions, call depth unbounded (recursion)\n", funcs);
+   else
+      fprintf(out, "; %u functions, call depth %u of %u\n", funcs, an->max_depth, MAX_ADR_STACK);
+
+   fprintf(out, "; %u indirect jumps, %u unresolved\n", an->indirect, an->unresolved);
+   if (an->self_modifying)
+      fprintf(out, "; self-modifying: yes\n");
+   else if (an->blind_writes)
+      fprintf(out, "; self-modifying: unknown, %u stores through a computed I\n", an->blind_writes);
+   else
+      fprintf(out, "; self-modifying: no\n");
+}
+
+void analysis_dot(const Analysis *an, const u8 *ram, FILE *out) {
+   char text[32];
+   fprintf(out, "digraph cfg {\n   node [shape=box fontname=monospace];\n");
+   for (u32 b = 0; b < an->num_blocks; ++b) {
+      const AnBlock *block = &an->blocks[b];
+      fprintf(out, "   b%03X [label=\"", block->start);
+      for (u32 adr = block->start; adr < block->end; adr += 2) {
+         analysis_disasm(instr_at(ram, adr), text, sizeof(text));
+         fprintf(out, "%03X  %s\\l", adr, text);
+      }
+      fprintf(out, "\"%s];\n", an->FLAGS[block->start] & AN_FUNC ? " peripheries=2" : "");
+   }
+
+   static const char *STYLES[] = {"", "", " color=blue", " style=dashed", " color=red"};
+   for (u32 e = 0; e < an->num_edges; ++e) {
+      const AnEdge *edge = &an->edges[e];
+      const s32 from = analysis_block_at(an, edge->from);
+      if (from >= 0)
+         fprintf(out, "   b%03X -> b%03X [label=%s%s];\n", an->blocks[from].start, edge->to, EDGE_KINDS[edge->kind],
+                 STYLES[edge->kind]);
+   }
+   fprintf(out, "}\n");
+}
+
+void analysis_json(const Analysis *an, const u8 *ram, FILE *out) {
+   char text[32];
+   fprintf(out, "{\n  \"entry\": %u,\n  \"end\": %u,\n  \"blocks\": [", PROGRAM_START_ADR, an->end);
+   for (u32 b = 0; b < an->num_blocks; ++b) {
+      const AnBlock *block = &an->blocks[b];
+      fprintf(out, "%s\n    {\"start\": %u, \"end\": %u, \"code\": [", b ? "," : "", block->start, block->end);
+      for (u32 adr = block->start; adr < block->end; adr += 2) {
+         analysis_disasm(instr_at(ram, adr), text, sizeof(text));
+         fprintf(out, "%s\"%s\"", adr > block->start ? ", " : "", text);
+      }
+      fprintf(out, "]}");
+   }
+
+   fprintf(out, "\n  ],\n  \"edges\": [");
+   for (u32 e = 0; e < an->num_edges; ++e) {
+      const AnEdge *edge = &an->edges[e];
+      fprintf(out, "%s\n    {\"from\": %u, \"to\": %u, \"kind\": \"%s\"}", e ? "," : "", edge->from, edge->to,
+              EDGE_KINDS[edge->kind]);
+   }
+
+   fprintf(out, "\n  ],\n  \"functions\": [");
+   bool first = true;
+   for (u32 adr = 0; adr < RAM_SIZE; ++adr) {
+      if (!(an->FLAGS[adr] & AN_FUNC))
+         continue;
+      if (an->depths[adr] == AN_DEPTH_UNBOUNDED)
+         fprintf(out, "%s\n    {\"entry\": %u, \"depth\": null}", first ? "" : ",", adr);
+      else
+         fprintf(out, "%s\n    {\"entry\": %u, \"depth\": %u}", first ? "" : ",", adr, an->depths[adr]);
+      first = false;
+   }
+
+   fprintf(out, "\n  ],\n  \"data\": [");
+   first = true;
+   for (u32 adr = PROGRAM_START_ADR; adr < an->end;) {
+      if (an->FLAGS[adr] & AN_CODE) {
+         adr += 2;
+         continue;
+      }
+      const u16 run = data_run(an, adr, an->end);
+      fprintf(out, "%s\n    {\"start\": %u, \"end\": %u, \"kind\": \"%s\"}", first ? "" : ",", adr, adr + run,
+              data_kind(an->FLAGS[adr]));
+      first = false;
+      adr += run;
+   }
+
+   fprintf(out, "\n  ],\n");
+   if (an->max_depth == AN_DEPTH_UNBOUNDED)
+      fprintf(out, "  \"max_depth\": null,\n");
+   else
+      fprintf(out, "  \"max_depth\": %u,\n", an->max_depth);
+   fprintf(out, "  \"indirect\": %u,\n  \"unresolved\": %u,\n  \"blind_writes\": %u,\n  \"self_modifying\": %s\n}\n",
+           an->indirect, an->unresolved, an->blind_writes, an->self_modifying ? "true" : "false");
+}
+
+static u16 instr_at(const u8 *ram, u16 adr) {
+   return ram[adr % RAM_SIZE] << 8 | ram[(adr + 1) % RAM_SIZE];
+}
+
+static bool is_control(u16 instr) {
+   switch (instr >> 12) {
+   case 0x0:
+      return instr == 0x00EE;
+   case 0x1:
+   case 0x2:
+   case 0x3:
+   case 0x4:
+   case 0x5:
+   case 0x9:
+   case 0xB:
+   case 0xE:
+      return true;
+   }
+   return false;
+}
+
+static bool is_valid(u16 instr) {
+   char text[32];
+   // machine code routines (0nnn) are not emulated, reaching one means running into data
+   return instr == 0x00E0 || instr == 0x00EE ||
+          ((instr >> 12) != 0 && analysis_disasm(instr, text, sizeof(text)) && strncmp(text, "DW", 2) != 0);
+}
+
+static void push(Worklist *work, u32 adr) {
+   if (adr < RAM_SIZE && !work->queued[adr]) {
+      work->queued[adr] = true;
+      work->items[work->count++] = adr;
+   }
+}
+
+// recursive descent over a worklist until no new instruction turns up
+static void explore(Analysis *an, const u8 *ram, Worklist *work) {
+   while (work->count > 0) {
+      const u16 pc = work->items[--work->count];
+      if (pc + 1 >= RAM_SIZE) {
+         an->FLAGS[pc] |= AN_INVALID; // runs off the end of RAM
+         continue;
+      }
+
+      const u16 instr = instr_at(ram, pc);
+      if (!is_valid(instr)) {
+         an->FLAGS[pc] |= AN_INVALID;
+         continue;
+      }
+      an->FLAGS[pc] |= AN_CODE;
+      an->FLAGS[pc + 1] |= AN_OPERAND;
+
+      const u16 NNN = instr & 0xFFF;
+      switch (instr >> 12) {
+      case 0x0:
+         if (instr == 0x00E0)
+            push(work, pc + 2);
+         break;
+      case 0x1:
+         add_edge(an, pc, NNN, AN_JUMP, work);
+         break;
+      case 0x2:
+         an->FLAGS[NNN] |= AN_FUNC;
+         add_edge(an, pc, NNN, AN_CALL, work);
+         add_edge(an, pc, pc + 2, AN_FALL, work); // returns here
+         break;
+      case 0x3:
+      case 0x4:
+      case 0x5:
+      case 0x9:
+      case 0xE:
+         add_edge(an, pc, pc + 2, AN_FALL, work);
+         add_edge(an, pc, pc + 4, AN_SKIP, work);
+         break;
+      case 0xB:
+         ++an->indirect;
+         resolve_indirect(an, ram, pc, work);
+         break;
+      default:
+         push(work, pc + 2);
+         break;
+      }
+   }
+}
+
+static void add_edge(Analysis *an, u16 from, u16 to, AnEdgeKind kind, Worklist *work) {
+   to %= RAM_SIZE;
+   if (an->num_edges < AN_MAX_EDGES)
+      an->edges[an->num_edges++] = (AnEdge){.from = from, .to = to, .kind = kind};
+   else
+      ++an->dropped_edges;
+
+   an->FLAGS[to] |= AN_LEADER;
+   push(work, to);
+}
+
+// value of V[reg] before the instruction at adr, following the straight-line code that led there
+static u16 const_before(const Analysis *an, const u8 *ram, u16 adr, u8 reg) {
+   u16 added = 0;
+   for (u16 a = adr; !(an->FLAGS[a] & AN_LEADER) && a >= 2;) {
+      a -= 2;
+      const u16 instr = instr_at(ram, a);
+      if (!(an->FLAGS[a] & AN_CODE) || is_control(instr))
+         return NO_CONST; // adr is not reached by falling through from a alone
+
+      const u16 X = (instr >> 8) & 0xF;
+      const u16 NN = instr & 0xFF;
+      switch (instr >> 12) {
+      case 0x6:
+         if (X == reg)
+            return (NN + added) & 0xFF;
+         break;
+      case 0x7:
+         if (X == reg)
+            added += NN;
+         break;
+      case 0x8:
+         if (X == reg || reg == 0xF)
+            return NO_CONST;
+         break;
+      case 0xC:
+         if (X == reg)
+            return NO_CONST;
+         break;
+      case 0xD:
+         if (reg == 0xF)
+            return NO_CONST;
+         break;
+      case 0xF:
+         if ((X == reg && (NN == 0x07 || NN == 0x0A)) || (NN == 0x65 && reg <= X))
+            return NO_CONST;
+         break;
+      }
+   }
+   return NO_CONST;
+}
+
+// Bnnn: one target for a constant register, else the entries of a jump table at nnn
+static void resolve_indirect(Analysis *an, const u8 *ram, u16 adr, Worklist *work) {
+   const u16 instr = instr_at(ram, adr);
+   const u16 NNN = instr & 0xFFF;
+#ifdef Q_JUMPING
+   const u8 reg = (instr >> 8) & 0xF;
+#else
+   const u8 reg = 0;
+#endif
+
+   // the block containing adr is not final yet, but instructions found later only split it before adr
+   const u16 value = const_before(an, ram, adr, reg);
+   if (value != NO_CONST) {
+      add_edge(an, adr, NNN + value, AN_INDIRECT, work);
+      return;
+   }
+
+   u32 entries = 0;
+   for (u16 t = NNN; entries < AN_MAX_TABLE && t + 1 < RAM_SIZE && (instr_at(ram, t) >> 12) == 0x1; t += 2) {
+      add_edge(an, adr, t, AN_INDIRECT, work);
+      ++entries;
+   }
+   an->unresolved += entries == 0;
+}
+
+static void build_blocks(Analysis *an, const u8 *ram) {
+   // a block runs from a leader to a control instruction, the next leader or the end of reachable code
+   for (u32 adr = 0; adr < RAM_SIZE && an->num_blocks < AN_MAX_BLOCKS; ++adr) {
+      if ((an->FLAGS[adr] & (AN_LEADER | AN_CODE)) != (AN_LEADER | AN_CODE))
+         continue;
+
+      u16 a = adr;
+      for (;;) {
+         const u16 next = a + 2;
+         if (is_control(instr_at(ram, a)) || next >= RAM_SIZE || !(an->FLAGS[next] & AN_CODE))
+            break;
+         if (an->FLAGS[next] & AN_LEADER) {
+            if (an->num_edges < AN_MAX_EDGES)
+               an->edges[an->num_edges++] = (AnEdge){.from = a, .to = next, .kind = AN_FALL};
+            else
+               ++an->dropped_edges;
+            break;
+         }
+         a = next;
+      }
+      an->blocks[an->num_blocks++] = (AnBlock){.start = adr, .end = a + 2};
+   }
+   qsort(an->edges, an->num_edges, sizeof(an->edges[0]), compare_edges);
+}
+
+// I at the start of each block is the value it has on every way in, or unknown, found by iterating to a fixed point
+static void classify_data(Analysis *an, const u8 *ram) {
+   u16 *in = malloc(an->num_blocks * sizeof(*in));
+   for (u32 b = 0; b < an->num_blocks; ++b)
+      in[b] = an->blocks[b].start == PROGRAM_START_ADR ? NO_CONST : I_UNSET;
+
+   for (bool changed = true; changed;) {
+      changed = false;
+      for (u32 b = 0; b < an->num_blocks; ++b) {
+         if (in[b] == I_UNSET)
+            continue;
+
+         const u16 last = an->blocks[b].end - 2;
+         const u16 out = follow_i(an, ram, &an->blocks[b], in[b], false);
+         u32 count = 0;
+         const AnEdge *edges = edges_from(an, last, &count);
+         for (u32 e = 0; e < count; ++e) {
+            const s32 to = analysis_block_at(an, edges[e].to);
+            if (to < 0 || an->blocks[to].start != edges[e].to)
+               continue;
+
+            // the callee may have moved I by the time it returns
+            const bool returned = edges[e].kind == AN_FALL && (instr_at(ram, last) >> 12) == 0x2;
+            const u16 value = returned ? NO_CONST : out;
+            const u16 merged = in[to] == I_UNSET || in[to] == value ? value : NO_CONST;
+            changed |= merged != in[to];
+            in[to] = merged;
+         }
+      }
+   }
+
+   for (u32 b = 0; b < an->num_blocks; ++b)
+      follow_i(an, ram, &an->blocks[b], in[b] == I_UNSET ? NO_CONST : in[b], true);
+   free(in);
+
+   for (u32 adr = 0; adr < RAM_SIZE; ++adr) {
+      if ((an->FLAGS[adr] & AN_WRITE) && (an->FLAGS[adr] & (AN_CODE | AN_OPERAND)))
+         an->self_modifying = true;
+   }
+}
+
+// I after the block, given I before it, marking the bytes accessed through it when classifying
+static u16 follow_i(Analysis *an, const u8 *ram, const AnBlock *block, u16 I, bool classify) {
+   for (u16 adr = block->start; adr < block->end; adr += 2) {
+      const u16 instr = instr_at(ram, adr);
+      const u16 X = (instr >> 8) & 0xF;
+      switch (instr >> 12) {
+      case 0xA:
+         I = instr & 0xFFF;
+         break;
+      case 0xD:
+         if (classify && I != NO_CONST)
+            mark(an, I, instr & 0xF, AN_SPRITE);
+         break;
+      case 0xF:
+         switch (instr & 0xFF) {
+         case 0x1E:
+         case 0x29:
+            I = NO_CONST; // indexed or a font digit
+            break;
+         case 0x33:
+            if (classify && I != NO_CONST)
+               mark(an, I, 3, AN_WRITE);
+            else if (classify)
+               ++an->blind_writes;
+            break;
+         case 0x55:
+         case 0x65:
+            if (I == NO_CONST) {
+               an->blind_writes += classify && (instr & 0xFF) == 0x55;
+               break;
+            }
+            if (classify)
+               mark(an, I, X + 1, (instr & 0xFF) == 0x55 ? AN_WRITE : AN_READ);
+#ifdef Q_MEMORY
+            I = (I + X + 1) % RAM_SIZE;
+#endif
+            break;
+         }
+         break;
+      }
+   }
+   return I;
+}
+
+static void mark(Analysis *an, u16 adr, u16 len, u8 flag) {
+   for (u16 i = 0; i < len; ++i)
+      an->FLAGS[(adr + i) % RAM_SIZE] |= flag;
+}
+
+static int compare_edges(const void *a, const void *b) {
+   const AnEdge *ea = a;
+   const AnEdge *eb = b;
+   if (ea->from != eb->from)
+      return ea->from < eb->from ? -1 : 1;
+   return ea->to < eb->to ? -1 : ea->to > eb->to;
+}
+
+static const AnEdge *edges_from(const Analysis *an, u16 adr, u32 *count) {
+   u32 lo = 0;
+   u32 hi = an->num_edges;
+   while (lo < hi) {
+      const u32 mid = (lo + hi) / 2;
+      if (an->edges[mid].from < adr)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   *count = 0;
+   while (lo + *count < an->num_edges && an->edges[lo + *count].from == adr)
+      ++*count;
+   return &an->edges[lo];
+}
+
+// state: 0 unvisited, 1 on the call path, 2 done
+static u16 func_depth(Analysis *an, const u8 *ram, u16 entry, u8 *state) {
+   if (state[entry] == 2)
+      return an->depths[entry];
+   if (state[entry] == 1)
+      return AN_DEPTH_UNBOUNDED;
+   state[entry] = 1;
+
+   // the function body: everything reachable without taking a call or a return
+   u8 *seen = calloc(RAM_SIZE, 1);
+   u16 *work = malloc(RAM_SIZE * sizeof(*work));
+   u16 *callees = malloc(RAM_SIZE * sizeof(*callees));
+   u32 num_work = 0;
+   u32 num_callees = 0;
+   work[num_work++] = entry;
+   seen[entry] = SEEN_BODY;
+   while (num_work > 0) {
+      const u16 pc = work[--num_work];
+      if (!(an->FLAGS[pc] & AN_CODE))
+         continue;
+
+      const u16 instr = instr_at(ram, pc);
+      u32 count = 0;
+      const AnEdge *edges = edges_from(an, pc, &count);
+      if (!is_control(instr) && pc + 2 < RAM_SIZE && !(an->FLAGS[pc + 2] & AN_LEADER)) {
+         count = 0; // plain fallthrough within a block
+         if (!(seen[pc + 2] & SEEN_BODY)) {
+            seen[pc + 2] |= SEEN_BODY;
+            work[num_work++] = pc + 2;
+         }
+      }
+      for (u32 e = 0; e < count; ++e) {
+         const u16 to = edges[e].to;
+         const u8 bit = edges[e].kind == AN_CALL ? SEEN_CALLEE : SEEN_BODY;
+         if (seen[to] & bit)
+            continue;
+         seen[to] |= bit;
+         if (bit == SEEN_CALLEE)
+            callees[num_callees++] = to;
+         else
+            work[num_work++] = to;
+      }
+   }
+   free(seen);
+   free(work);
+
+   u16 depth = 0;
+   for (u32 c = 0; c < num_callees && depth != AN_DEPTH_UNBOUNDED; ++c) {
+      const u16 d = func_depth(an, ram, callees[c], state);
+      depth = d == AN_DEPTH_UNBOUNDED ? d : d + 1 > depth ? d + 1 : depth;
+   }
+   free(callees);
+
+   an->depths[entry] = depth;
+   state[entry] = 2;
+   return depth;
+}
+
+static const char *data_kind(u8 flags) {
+   if (flags & AN_SPRITE)
+      return "sprite";
+   if (flags & AN_READ)
+      return "loaded";
+   if (flags & AN_WRITE)
+      return "stored";
+   return "unreferenced";
+}
+
+// bytes from adr on with the same data kind, up to the next instruction or end
+static u16 data_run(const Analysis *an, u16 adr, u16 end) {
+   const char *kind = data_kind(an->FLAGS[adr]);
+   u16 run = 1;
+   while (adr + run < end && !(an->FLAGS[adr + run] & AN_CODE) && data_kind(an->FLAGS[adr + run]) == kind)
+      ++run;
+   return run;
+}
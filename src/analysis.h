@@ -0,0 +1,78 @@
+#ifndef _ANALYSIS
+#define _ANALYSIS
+#include "chip8.h"
+
+#define AN_MAX_BLOCKS (RAM_SIZE / 2)
+#define AN_MAX_EDGES (RAM_SIZE * 2)
+#define AN_MAX_TABLE 128  // entries of a Bnnn jump table followed
+#define AN_DEPTH_UNBOUNDED UINT16_MAX // recursion
+
+// per-address flags
+enum {
+   AN_CODE = 1 << 0,    // first byte of a reachable instruction
+   AN_OPERAND = 1 << 1, // second byte of one
+   AN_LEADER = 1 << 2,  // starts a basic block
+   AN_FUNC = 1 << 3,    // entry point or call target
+   AN_SPRITE = 1 << 4,  // drawn by Dxyn
+   AN_READ = 1 << 5,    // loaded by Fx65
+   AN_WRITE = 1 << 6,   // written by Fx33 / Fx55
+   AN_INVALID = 1 << 7, // reached but not an instruction, the path ends there
+};
+
+typedef enum AnEdgeKind { AN_FALL, AN_JUMP, AN_SKIP, AN_CALL, AN_INDIRECT } AnEdgeKind;
+
+typedef struct AnEdge {
+   u16 from; // address of the branching instruction
+   u16 to;
+   AnEdgeKind kind;
+} AnEdge;
+
+typedef struct AnBlock {
+   u16 start;
+   u16 end; // one past its last instruction
+} AnBlock;
+
+/*
+ * Static analysis of a program in RAM, by recursive descent from PROGRAM_START_ADR.
+ *
+ * Every instruction reachable through fallthrough, jumps, skips (both ways) and calls (assumed to return) is code.
+ * Bnnn goes to the single target when V0 holds a constant set earlier in its block, otherwise to each entry of a jump
+ * table at nnn (consecutive 1nnn instructions), or nowhere known. I is followed across blocks while every way into a
+ * block agrees on it (calls return with it unknown), so bytes drawn, loaded or stored through an I set by Annn are
+ * classified, and stores through an unknown I are counted.
+ *
+ * Functions are the entry point and call targets. A function's depth is the most return addresses it can have on the
+ * stack below it, following the calls reachable from its entry without returning.
+ */
+typedef struct Analysis {
+   u8 FLAGS[RAM_SIZE];
+   u16 end; // program bytes end here, RAM after it is not reported as data
+
+   AnBlock blocks[AN_MAX_BLOCKS];
+   u32 num_blocks;
+   AnEdge edges[AN_MAX_EDGES];
+   u32 num_edges;
+   u32 dropped_edges; // past AN_MAX_EDGES
+
+   u16 depths[RAM_SIZE]; // call depth of each AN_FUNC address
+   u16 max_depth;        // of the entry point, AN_DEPTH_UNBOUNDED with recursion
+
+   u32 indirect;     // Bnnn jumps
+   u32 unresolved;   // Bnnn jumps with no target found
+   u32 blind_writes;    // Fx33 / Fx55 through an I not known statically, they may land anywhere
+   bool self_modifying; // a store through a known I overlaps code
+} Analysis;
+
+// ram holds the loaded program, size its length from PROGRAM_START_ADR
+Analysis *analysis_run(const u8 *ram, u32 size);
+void analysis_terminate(Analysis **an);
+
+bool analysis_is_code(const Analysis *an, u16 adr); // either byte of a reachable instruction
+u32 analysis_disasm(u16 instr, char *out, u32 len); // Cowgod style mnemonic, returns its length
+s32 analysis_block_at(const Analysis *an, u16 adr); // block holding adr, -1 when none
+
+void analysis_print(const Analysis *an, const u8 *ram, FILE *out); // listing and summary
+void analysis_dot(const Analysis *an, const u8 *ram, FILE *out);   // Graphviz CFG, one node per block
+void analysis_json(const Analysis *an, const u8 *ram, FILE *out);
+
+#endif
@@ -0,0 +1,61 @@
+#include "analysis.h"
+#include "utils.h"
+
+/*
+ * Static analysis of a ROM without running it (analysis.h): disassembly with code and data told apart, the control
+ * flow graph, call depth bounds, indirect jumps and self-modification.
+ *
+ * Usage: analyze [--dot | --json] rom
+ *   default : annotated listing and a summary
+ *   --dot   : control flow graph for Graphviz, one node per basic block
+ *   --json  : blocks, edges, functions and data ranges
+ */
+
+int main(int argc, char **argv) {
+   bool dot = false;
+   bool json = false;
+   char *rom = NULL;
+   for (s32 i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--dot") == 0)
+         dot = true;
+      else if (strcmp(argv[i], "--json") == 0)
+         json = true;
+      else
+         rom = argv[i];
+   }
+
+   if (!rom || (dot && json)) {
+      printf("Usage: analyze [--dot | --json] rom\n");
+      return 1;
+   }
+
+   u32 app_size = 0;
+   void *app = read_bin_file(rom, &app_size);
+   if (!app) {
+      printf("MISSING %s\n", rom);
+      return 1;
+   }
+
+   // the program as the interpreter sees it, font included
+   Chip8 *state = chip8_init();
+   chip8_load_app(state, app, app_size);
+   free(app);
+
+   Analysis *an = analysis_run(state->RAM, app_size);
+   if (!an) {
+      printf("%s does not fit in RAM\n", rom);
+      chip8_terminate(&state);
+      return 1;
+   }
+
+   if (dot)
+      analysis_dot(an, state->RAM, stdout);
+   else if (json)
+      analysis_json(an, state->RAM, stdout);
+   else
+      analysis_print(an, state->RAM, stdout);
+
+   analysis_terminate(&an);
+   chip8_terminate(&state);
+   return 0;
+}
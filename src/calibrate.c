@@ -0,0 +1,65 @@
+#include "ipf.h"
+#include "utils.h"
+
+/*
+ * Calibrates instructions per frame for ROMs and stores their profiles (ipf.h).
+ *
+ * Usage: calibrate [--profiles path] [--dry] roms...
+ *   --profiles : profile file to update, IPF_PROFILE_PATH by default
+ *   --dry      : print the profiles only
+ */
+
+#ifndef IPF_PROFILE_PATH
+#define IPF_PROFILE_PATH "roms/ipf.txt" // assuming we are not in build dir
+#endif
+
+int main(int argc, char **argv) {
+   const char *path = IPF_PROFILE_PATH;
+   bool dry = false;
+   u32 count = 0;
+   for (s32 i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--profiles") == 0 && i + 1 < argc)
+         path = argv[++i];
+      else if (strcmp(argv[i], "--dry") == 0)
+         dry = true;
+      else
+         argv[1 + count++] = argv[i]; // ROMs, compacted in place
+   }
+
+   if (!count) {
+      printf("Usage: calibrate [--profiles path] [--dry] roms...\n");
+      return 1;
+   }
+
+   printf("%-5s %-5s %-6s %-7s %s\n", "IPF", "MODE", "WAIT", "DRAWS/S", "ROM");
+   u32 failures = 0;
+   for (u32 i = 0; i < count; ++i) {
+      u32 size = 0;
+      void *app = read_bin_file(argv[1 + i], &size);
+      if (!app) {
+         printf("MISSING %s\n", argv[1 + i]);
+         ++failures;
+         continue;
+      }
+
+      const char *slash = strrchr(argv[1 + i], '/');
+      const char *name = slash ? slash + 1 : argv[1 + i];
+
+      IpfProfile profile;
+      const u64 time_beg = time_in_ns();
+      const bool ok = ipf_calibrate(app, size, name, &profile);
+      const u64 time_diff_ns = time_in_ns() - time_beg;
+      free(app);
+      if (!ok) {
+         ++failures;
+         continue;
+      }
+
+      printf("%-5u %-5s %5.1f%% %7.1f %s (%.1f ms)\n", profile.ipf, profile.synced ? "timer" : "free",
+             profile.wait_share * 100, profile.draw_rate, name, time_diff_ns / 1000000.0);
+      if (!dry && !ipf_save(path, &profile))
+         return 1;
+   }
+
+   return failures ? 1 : 0;
+}
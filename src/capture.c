@@ -0,0 +1,305 @@
+#include "capture.h"
+
+#define GIF_MIN_CODE_SIZE 2 // two colours, but GIF wants at least 2 bits
+#define GIF_MIN_DELAY_CS 2 // viewers slow down anything shorter
+#define GIF_LAST_DELAY_CS 100
+#define GIF_BLOCK 255
+
+// same shades as the window
+static const u8 GIF_PALETTE[] = {14, 14, 14, 255, 255, 255};
+
+typedef struct BitWriter {
+   FILE *file;
+   u8 block[GIF_BLOCK];
+   u32 len;
+   u32 acc;
+   u32 bits;
+} BitWriter;
+
+static void *encode(void *userdata);
+static void write_header(Capture *cap);
+static void write_frame(Capture *cap, const u8 *bits, const u8 *prev, u32 delay_cs);
+static void write_trailer(Capture *cap);
+static void write_lzw(Capture *cap, const u8 *pixels, u32 count);
+static void put_code(BitWriter *w, u32 code, u32 size);
+static void put_byte(BitWriter *w, u8 byte);
+static void flush_bits(BitWriter *w);
+static void put_u16(FILE *file, u16 v);
+static bool pixel(const u8 *bits, u32 x, u32 y);
+
+Capture *capture_init(const char *path, u32 scale) {
+   FILE *file = fopen(path, "wb");
+   if (!file) {
+      printf("Failed to open %s for capture\n", path);
+      return NULL;
+   }
+
+   Capture *cap = calloc(1, sizeof(*cap));
+   cap->file = file;
+   const size_t len = strlen(path);
+   cap->gif = len >= 4 && strcmp(&path[len - 4], ".gif") == 0;
+   cap->scale = scale ? scale : CAPTURE_DEFAULT_SCALE;
+   spsc_init(&cap->frames, CAPTURE_QUEUE, sizeof(CaptureFrame));
+
+   write_header(cap);
+   pthread_create(&cap->thread, NULL, encode, cap);
+   return cap;
+}
+
+void capture_terminate(Capture **cap) {
+   if (*cap) {
+      __atomic_store_n(&(*cap)->stop, true, __ATOMIC_RELEASE);
+      pthread_join((*cap)->thread, NULL);
+      write_trailer(*cap);
+      fclose((*cap)->file);
+      if ((*cap)->dropped)
+         printf("Capture dropped %llu frames\n", (unsigned long long)(*cap)->dropped);
+      spsc_terminate(&(*cap)->frames);
+      free(*cap);
+   }
+   *cap = NULL;
+}
+
+void capture_frame(Capture *cap, const Chip8 *state, u64 time_ms) {
+   CaptureFrame frame;
+   chip8_pack_display(state, frame.bits);
+
+   if (cap->has_last && memcmp(frame.bits, cap->last, CAPTURE_PACKED) == 0)
+      return;
+
+   if (!cap->has_last)
+      cap->time_beg = time_ms;
+   frame.time_ms = time_ms - cap->time_beg;
+
+   // a full queue costs a frame, never a wait
+   if (!spsc_push(&cap->frames, &frame)) {
+      cap->dropped++;
+      return;
+   }
+   memcpy(cap->last, frame.bits, CAPTURE_PACKED);
+   cap->has_last = true;
+}
+
+static void *encode(void *userdata) {
+   Capture *cap = userdata;
+
+   // a GIF frame is held back until the next one tells how long it stays up
+   CaptureFrame held = {0};
+   bool holding = false;
+   u8 shown[CAPTURE_PACKED] = {0}; // last frame written
+   u8 rle_prev[CAPTURE_PACKED] = {0};
+
+   CaptureFrame frame;
+   while (true) {
+      if (!spsc_pop(&cap->frames, &frame)) {
+         // stopping waits for the queue to drain
+         const bool stop = __atomic_load_n(&cap->stop, __ATOMIC_ACQUIRE);
+         if (stop && !spsc_pop(&cap->frames, &frame))
+            break;
+         if (!stop) {
+            usleep(CAPTURE_IDLE_US);
+            continue;
+         }
+      }
+
+      if (!cap->gif) {
+         const u32 t = frame.time_ms;
+         const u8 le[4] = {t, t >> 8, t >> 16, t >> 24};
+         fwrite(le, 1, sizeof(le), cap->file);
+
+         // XOR against the previous frame, as skip / literal runs
+         u32 i = 0;
+         while (i < CAPTURE_PACKED) {
+            u8 skip = 0;
+            while (i < CAPTURE_PACKED && skip < UINT8_MAX && frame.bits[i] == rle_prev[i])
+               ++skip, ++i;
+            u8 count = 0;
+            u8 literal[UINT8_MAX];
+            while (i < CAPTURE_PACKED && count < UINT8_MAX && frame.bits[i] != rle_prev[i]) {
+               literal[count++] = frame.bits[i] ^ rle_prev[i];
+               ++i;
+            }
+            fputc(skip, cap->file);
+            fputc(count, cap->file);
+            fwrite(literal, 1, count, cap->file);
+         }
+         memcpy(rle_prev, frame.bits, CAPTURE_PACKED);
+         cap->written++;
+         continue;
+      }
+
+      // delays from absolute times so rounding does not drift, frames up for less than the
+      // shortest delay take their successor's pixels and keep their start
+      const u32 delay_cs = frame.time_ms / 10 - held.time_ms / 10;
+      if (!holding) {
+         held = frame;
+         holding = true;
+      } else if (delay_cs >= GIF_MIN_DELAY_CS) {
+         write_frame(cap, held.bits, cap->written ? shown : NULL, delay_cs);
+         memcpy(shown, held.bits, CAPTURE_PACKED);
+         held = frame;
+      } else {
+         memcpy(held.bits, frame.bits, CAPTURE_PACKED);
+      }
+   }
+
+   if (holding)
+      write_frame(cap, held.bits, cap->written ? shown : NULL, GIF_LAST_DELAY_CS);
+   return NULL;
+}
+
+static void write_header(Capture *cap) {
+   if (!cap->gif) {
+      fwrite("C8RL", 1, 4, cap->file);
+      fputc(DISPLAY_WIDTH, cap->file);
+      fputc(DISPLAY_HEIGHT, cap->file);
+      return;
+   }
+
+   fwrite("GIF89a", 1, 6, cap->file);
+   put_u16(cap->file, DISPLAY_WIDTH * cap->scale);
+   put_u16(cap->file, DISPLAY_HEIGHT * cap->scale);
+   fputc(0x80, cap->file); // global colour table of 2 entries
+   fputc(0, cap->file);    // background colour
+   fputc(0, cap->file);    // pixel aspect ratio
+   fwrite(GIF_PALETTE, 1, sizeof(GIF_PALETTE), cap->file);
+
+   // loop forever
+   fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, cap->file);
+}
+
+static void write_frame(Capture *cap, const u8 *bits, const u8 *prev, u32 delay_cs) {
+   // bounding box of the changed pixels, the whole screen for the first frame
+   u32 x0 = 0, y0 = 0, x1 = DISPLAY_WIDTH, y1 = DISPLAY_HEIGHT;
+   if (prev) {
+      x0 = DISPLAY_WIDTH, y0 = DISPLAY_HEIGHT, x1 = 0, y1 = 0;
+      for (u32 y = 0; y < DISPLAY_HEIGHT; ++y) {
+         for (u32 x = 0; x < DISPLAY_WIDTH; ++x) {
+            if (pixel(bits, x, y) != pixel(prev, x, y)) {
+               x0 = x < x0 ? x : x0;
+               y0 = y < y0 ? y : y0;
+               x1 = x + 1 > x1 ? x + 1 : x1;
+               y1 = y + 1 > y1 ? y + 1 : y1;
+            }
+         }
+      }
+      if (x1 == 0) // unchanged after all, e.g. a flicker that was coalesced away
+         x0 = 0, y0 = 0, x1 = 1, y1 = 1;
+   }
+
+   const u32 s = cap->scale;
+   const u32 w = (x1 - x0) * s;
+   const u32 h = (y1 - y0) * s;
+
+   // graphic control extension: keep the previous frame underneath, delay in centiseconds
+   fwrite("\x21\xF9\x04\x04", 1, 4, cap->file);
+   put_u16(cap->file, delay_cs > UINT16_MAX ? UINT16_MAX : delay_cs);
+   fputc(0, cap->file);
+   fputc(0, cap->file);
+
+   // image descriptor, no local colour table
+   fputc(0x2C, cap->file);
+   put_u16(cap->file, x0 * s);
+   put_u16(cap->file, y0 * s);
+   put_u16(cap->file, w);
+   put_u16(cap->file, h);
+   fputc(0, cap->file);
+
+   u8 *pixels = malloc(w * h);
+   for (u32 y = 0; y < h; ++y) {
+      for (u32 x = 0; x < w; ++x)
+         pixels[y * w + x] = pixel(bits, x0 + x / s, y0 + y / s);
+   }
+   write_lzw(cap, pixels, w * h);
+   free(pixels);
+
+   cap->written++;
+}
+
+static void write_trailer(Capture *cap) {
+   if (cap->gif)
+      fputc(0x3B, cap->file);
+}
+
+// GIF flavoured LZW, variable code size from GIF_MIN_CODE_SIZE + 1 up to 12 bits
+static void write_lzw(Capture *cap, const u8 *pixels, u32 count) {
+   const u32 clear = 1 << GIF_MIN_CODE_SIZE;
+   u16(*child)[GIF_ROOTS] = cap->lzw; // 0 for none, roots never appear as children
+
+   fputc(GIF_MIN_CODE_SIZE, cap->file);
+   BitWriter w = {.file = cap->file};
+
+   memset(cap->lzw, 0, sizeof(cap->lzw));
+   u32 size = GIF_MIN_CODE_SIZE + 1;
+   u32 max_code = clear + 1;
+   put_code(&w, clear, size);
+
+   u32 cur = pixels[0];
+   for (u32 i = 1; i < count; ++i) {
+      const u8 p = pixels[i];
+      if (child[cur][p]) {
+         cur = child[cur][p];
+         continue;
+      }
+
+      put_code(&w, cur, size);
+      child[cur][p] = ++max_code;
+      if (max_code >= (1u << size))
+         ++size;
+      if (max_code == GIF_MAX_CODES - 1) {
+         put_code(&w, clear, size);
+         memset(cap->lzw, 0, sizeof(cap->lzw));
+         size = GIF_MIN_CODE_SIZE + 1;
+         max_code = clear + 1;
+      }
+      cur = p;
+   }
+
+   // the decoder adds an entry for the last code too, and may widen its codes before reading the clear
+   put_code(&w, cur, size);
+   if (++max_code >= (1u << size) && size < 12)
+      ++size;
+   put_code(&w, clear, size);
+   put_code(&w, clear + 1, GIF_MIN_CODE_SIZE + 1); // end of information
+   flush_bits(&w);
+}
+
+static void put_code(BitWriter *w, u32 code, u32 size) {
+   w->acc |= code << w->bits;
+   w->bits += size;
+   while (w->bits >= 8) {
+      put_byte(w, w->acc & 0xFF);
+      w->acc >>= 8;
+      w->bits -= 8;
+   }
+}
+
+// data goes out in sub-blocks of up to 255 bytes
+static void put_byte(BitWriter *w, u8 byte) {
+   w->block[w->len++] = byte;
+   if (w->len == GIF_BLOCK) {
+      fputc(w->len, w->file);
+      fwrite(w->block, 1, w->len, w->file);
+      w->len = 0;
+   }
+}
+
+static void flush_bits(BitWriter *w) {
+   if (w->bits > 0)
+      put_byte(w, w->acc & 0xFF);
+   if (w->len > 0) {
+      fputc(w->len, w->file);
+      fwrite(w->block, 1, w->len, w->file);
+   }
+   fputc(0, w->file); // block terminator
+}
+
+static void put_u16(FILE *file, u16 v) {
+   fputc(v & 0xFF, file);
+   fputc(v >> 8, file);
+}
+
+static bool pixel(const u8 *bits, u32 x, u32 y) {
+   const u32 bit = y * DISPLAY_WIDTH + x;
+   return (bits[bit / 8] >> (7 - bit % 8)) & 1;
+}
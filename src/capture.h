@@ -0,0 +1,54 @@
+#ifndef _CAPTURE
+#define _CAPTURE
+#include "chip8.h"
+#include "spsc.h"
+#include <pthread.h>
+
+#define CAPTURE_QUEUE 256
+#define CAPTURE_DEFAULT_SCALE 4
+#define CAPTURE_IDLE_US 2000 // encoder sleep while the queue is empty
+#define CAPTURE_PACKED DISPLAY_PACKED
+#define GIF_MAX_CODES 4096 // 12 bit LZW codes
+#define GIF_ROOTS 4
+
+/*
+ * Records the display to a file on a background thread.
+ *
+ * The emulation thread packs the display to one bit per pixel and queues it only when it changed since the last
+ * queued frame, the encoder thread does everything else. Files ending in ".gif" get an animated GIF, upscaled, with
+ * each frame cropped to the region that changed. Anything else gets a native resolution delta-RLE stream:
+ *   "C8RL" u8 width u8 height, then per frame: u32 time_ms, and the XOR against the previous frame as
+ *   (u8 skip, u8 count, count bytes) runs until CAPTURE_PACKED bytes are covered (little endian, row-major, MSB first)
+ */
+
+typedef struct CaptureFrame {
+   u64 time_ms;
+   u8 bits[CAPTURE_PACKED];
+} CaptureFrame;
+
+typedef struct Capture {
+   pthread_t thread;
+   bool stop; // atomic, set on terminate
+   SpscQueue frames;
+
+   // emulation thread
+   u8 last[CAPTURE_PACKED];
+   bool has_last;
+   u64 time_beg;
+   u64 dropped;
+
+   // encoder thread
+   FILE *file;
+   bool gif;
+   u32 scale;
+   u32 written;
+   u16 lzw[GIF_MAX_CODES][GIF_ROOTS]; // code table, child code per pixel value
+} Capture;
+
+Capture *capture_init(const char *path, u32 scale);
+void capture_terminate(Capture **cap); // flushes queued frames and closes the file
+
+// queues the display if it changed, time_ms from any monotonic clock, never blocks
+void capture_frame(Capture *cap, const Chip8 *state, u64 time_ms);
+
+#endif
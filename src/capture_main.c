@@ -0,0 +1,305 @@
+#include "capture.h"
+#include "utils.h"
+
+/*
+ * Round trip check of the GIF capture.
+ *
+ * Each ROM runs headlessly with pseudo-random input while every frame is captured to a temporary GIF, at each
+ * upscale from 1 to --scale. The file is then decoded with an independent LZW decoder that requires every image to
+ * hold exactly its pixels followed by the end code, and the frames are composited. The final image must match the
+ * final display.
+ *
+ * Usage: capcheck [--frames F] [--ipf K] [--scale S] rom...
+ */
+
+#define DEFAULT_FRAMES 1200
+#define DEFAULT_IPF 12
+#define DEFAULT_MAX_SCALE 4
+#define CAPCHECK_SEED 1
+#define FRAME_MS_X3 50 // 60 Hz frames are 16.67 ms, times kept in thirds of a ms
+#define LZW_MAX_BITS 12
+#define LZW_CODES (1 << LZW_MAX_BITS)
+#define LZW_NO_CODE LZW_CODES // no previous code, right after a clear
+
+typedef struct GifReader {
+   const u8 *data;
+   u32 size;
+   u32 pos;
+   bool bad;
+} GifReader;
+
+typedef struct GifStats {
+   u32 frames;
+   u32 bad_frames; // pixel count or end code wrong
+   u32 codes;
+} GifStats;
+
+static bool run_rom(const char *path, u32 frames, u32 ipf, u32 scale);
+static bool decode_gif(const u8 *data, u32 size, u32 scale, u8 *canvas, GifStats *stats);
+static bool decode_lzw(GifReader *r, u32 min_size, u8 *pixels, u32 count, u32 *out_codes);
+static u8 get_u8(GifReader *r);
+static u16 get_u16(GifReader *r);
+static u32 get_blocks(GifReader *r, u8 *out, u32 max);
+
+int main(int argc, char **argv) {
+   u32 frames = DEFAULT_FRAMES;
+   u32 ipf = DEFAULT_IPF;
+   u32 max_scale = DEFAULT_MAX_SCALE;
+
+   s32 first_rom = argc;
+   for (s32 i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+         frames = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc)
+         ipf = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+         max_scale = atoi(argv[++i]);
+      else {
+         first_rom = i;
+         break;
+      }
+   }
+
+   if (first_rom == argc || max_scale == 0) {
+      printf("Usage: capcheck [--frames F] [--ipf K] [--scale S] rom...\n");
+      return 1;
+   }
+
+   u32 runs = 0;
+   u32 failures = 0;
+   for (s32 i = first_rom; i < argc; ++i) {
+      for (u32 s = 1; s <= max_scale; ++s) {
+         ++runs;
+         if (!run_rom(argv[i], frames, ipf, s))
+            ++failures;
+      }
+   }
+
+   printf("%u / %u captures decoded\n", runs - failures, runs);
+   return failures == 0 ? 0 : 1;
+}
+
+static bool run_rom(const char *path, u32 frames, u32 ipf, u32 scale) {
+   u32 app_size = 0;
+   void *app = read_bin_file((char *)path, &app_size);
+   if (!app) {
+      printf("MISSING %s\n", path);
+      return false;
+   }
+
+   char gif_path[] = "/tmp/capcheck-XXXXXX.gif";
+   const int fd = mkstemps(gif_path, 4);
+   if (fd < 0) {
+      printf("Failed to create a temporary file\n");
+      free(app);
+      return false;
+   }
+   close(fd);
+
+   Capture *cap = capture_init(gif_path, scale);
+   Chip8 *state = chip8_init();
+   chip8_load_app(state, app, app_size);
+   free(app);
+
+   // hold a random key now and then, and capture every frame as the app would
+   u32 rng = CAPCHECK_SEED;
+   u8 held = KEY_NONE;
+   for (u32 f = 0; f < frames && cap && !state->FAULT; ++f) {
+      rng ^= rng << 13;
+      rng ^= rng >> 17;
+      rng ^= rng << 5;
+      u8 released = KEY_NONE;
+      if (held != KEY_NONE && rng % 8 == 0)
+         released = held, held = KEY_NONE;
+      else if (held == KEY_NONE && rng % 16 == 0)
+         held = (rng >> 8) % NUM_KEYS;
+
+      chip8_set_keypad(state, held == KEY_NONE ? 0 : 1 << held, released);
+      chip8_run_fused(state, ipf);
+      chip8_tick_timers(state);
+      while (spsc_space(&cap->frames) == 0)
+         usleep(CAPTURE_IDLE_US); // let the encoder catch up, every frame is wanted
+      capture_frame(cap, state, (u64)f * FRAME_MS_X3 / 3);
+   }
+   const bool dropped = cap && cap->dropped;
+   capture_terminate(&cap);
+
+   u32 size = 0;
+   u8 *data = read_bin_file(gif_path, &size);
+   remove(gif_path);
+
+   const u32 width = DISPLAY_WIDTH * scale;
+   u8 *canvas = calloc(width * DISPLAY_HEIGHT * scale, 1);
+   GifStats stats = {0};
+   bool ok = data && !dropped && decode_gif(data, size, scale, canvas, &stats) && stats.bad_frames == 0;
+
+   u32 wrong = 0;
+   for (u32 y = 0; y < DISPLAY_HEIGHT * scale; ++y) {
+      for (u32 x = 0; x < width; ++x)
+         wrong += canvas[y * width + x] != state->DISPLAY[y / scale][x / scale];
+   }
+   ok = ok && wrong == 0;
+
+   printf("%-8s x%u %s (%u frames, %u codes", ok ? "OK" : "BAD", scale, path, stats.frames, stats.codes);
+   if (stats.bad_frames)
+      printf(", %u malformed", stats.bad_frames);
+   if (wrong)
+      printf(", %u pixels differ from the display", wrong);
+   if (dropped)
+      printf(", frames dropped");
+   printf(")\n");
+
+   free(canvas);
+   free(data);
+   chip8_terminate(&state);
+   return ok;
+}
+
+// false when the file structure itself is broken, malformed image data is counted in stats
+static bool decode_gif(const u8 *data, u32 size, u32 scale, u8 *canvas, GifStats *stats) {
+   GifReader r = {.data = data, .size = size};
+   const u32 width = DISPLAY_WIDTH * scale;
+   const u32 height = DISPLAY_HEIGHT * scale;
+
+   if (size < 13 || memcmp(data, "GIF89a", 6) != 0)
+      return false;
+   r.pos = 6;
+   if (get_u16(&r) != width || get_u16(&r) != height)
+      return false;
+   const u8 flags = get_u8(&r);
+   r.pos += 2;
+   if (flags & 0x80)
+      r.pos += 3 * (2 << (flags & 0x7)); // global colour table
+
+   u8 *block = malloc(size);
+   u8 *pixels = malloc(width * height);
+   bool ok = true;
+   while (ok && !r.bad) {
+      const u8 kind = get_u8(&r);
+      if (kind == 0x3B) // trailer
+         break;
+
+      if (kind == 0x21) { // extension
+         get_u8(&r);
+         get_blocks(&r, block, size);
+      } else if (kind == 0x2C) {
+         const u32 x0 = get_u16(&r);
+         const u32 y0 = get_u16(&r);
+         const u32 w = get_u16(&r);
+         const u32 h = get_u16(&r);
+         get_u8(&r);
+         const u32 min_size = get_u8(&r);
+         if (x0 + w > width || y0 + h > height || w * h == 0 || min_size < 2 || min_size > 8) {
+            ok = false;
+            break;
+         }
+
+         GifReader image = {.data = block, .size = get_blocks(&r, block, size)};
+         u32 codes = 0;
+         if (!decode_lzw(&image, min_size, pixels, w * h, &codes))
+            ++stats->bad_frames;
+         stats->codes += codes;
+         ++stats->frames;
+
+         for (u32 y = 0; y < h; ++y)
+            memcpy(&canvas[(y0 + y) * width + x0], &pixels[y * w], w);
+      } else {
+         ok = false;
+      }
+   }
+
+   free(pixels);
+   free(block);
+   return ok && !r.bad;
+}
+
+// exactly count pixels, then the end code, and nothing but padding after it
+static bool decode_lzw(GifReader *r, u32 min_size, u8 *pixels, u32 count, u32 *out_codes) {
+   static u16 prefix[LZW_CODES];
+   static u8 suffix[LZW_CODES];
+   static u8 first[LZW_CODES];
+   static u8 stack[LZW_CODES + 1];
+
+   const u32 clear = 1 << min_size;
+   const u32 end = clear + 1;
+   for (u32 c = 0; c < clear; ++c)
+      suffix[c] = first[c] = c;
+
+   u32 size = min_size + 1;
+   u32 next = end + 1;
+   u32 prev = LZW_NO_CODE;
+   u32 out = 0;
+   u64 bit = 0;
+   const u64 bits = (u64)r->size * 8;
+
+   while (bit + size <= bits) {
+      u32 code = 0;
+      for (u32 b = 0; b < size; ++b, ++bit)
+         code |= ((r->data[bit / 8] >> (bit % 8)) & 1) << b;
+      ++*out_codes;
+
+      if (code == clear) {
+         size = min_size + 1;
+         next = end + 1;
+         prev = LZW_NO_CODE;
+         continue;
+      }
+      if (code == end) {
+         // the rest of the last byte is padding, there must not be another byte
+         return out == count && (bit + 7) / 8 == r->size;
+      }
+
+      u32 len = 0;
+      u32 c = code;
+      if (prev == LZW_NO_CODE) {
+         if (code >= clear)
+            return false;
+      } else if (code == next) {
+         stack[len++] = first[prev];
+         c = prev;
+      } else if (code > next) {
+         return false;
+      }
+      for (; c >= clear; c = prefix[c])
+         stack[len++] = suffix[c];
+      stack[len++] = c;
+
+      if (out + len > count)
+         return false;
+      while (len)
+         pixels[out++] = stack[--len];
+
+      if (prev != LZW_NO_CODE && next < LZW_CODES) {
+         prefix[next] = prev;
+         suffix[next] = first[code == next ? prev : code];
+         first[next] = first[prev];
+         if (++next == (1u << size) && size < LZW_MAX_BITS)
+            ++size;
+      }
+      prev = code;
+   }
+   return false; // ran out before the end code
+}
+
+static u8 get_u8(GifReader *r) {
+   if (r->pos >= r->size) {
+      r->bad = true;
+      return 0;
+   }
+   return r->data[r->pos++];
+}
+
+static u16 get_u16(GifReader *r) {
+   const u16 lo = get_u8(r);
+   return lo | get_u8(r) << 8;
+}
+
+// concatenated data sub-blocks up to the terminator, returns their length
+static u32 get_blocks(GifReader *r, u8 *out, u32 max) {
+   u32 len = 0;
+   for (u8 n; (n = get_u8(r)) && !r->bad;) {
+      for (u32 i = 0; i < n && len < max; ++i)
+         out[len++] = get_u8(r);
+   }
+   return len;
+}
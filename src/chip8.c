@@ -1,45 +1,11 @@
 #include "chip8.h"
+#include "debug.h"
+#include "quirks.h"
 #include "utils.h"
 
 #define FONT_ADR 0x50
 #define FONT_STRIDE 5
 
-// Timers decremented at a rate of 60 Hz (60 times per second)
-#define TIMER_FREQ_HZ 60
-#define TIMER_THRESHOLD_MS ((1.0 / TIMER_FREQ_HZ) * 1000.0)
-
-/*
- * Select target hardware in CMakeLists
- * CHIP8 / SCHIP / XOCHIP
- *
- * Note: Extensions for SCHIP and XOCHIP are unimplemented.
- * Only quirks were fixed for the sake of the tests.
- *
- * Quirks:
- *
- * Q_VF_RESET
- * Q_MEMORY
- * Q_DISP_WAIT
- * Q_CLIPPING
- * Q_SHIFTING
- * Q_JUMPING
- */
-#ifdef CHIP8
-#define Q_VF_RESET
-#define Q_MEMORY
-#define Q_DISP_WAIT
-#define Q_CLIPPING
-
-#elif defined(SCHIP)
-#define Q_CLIPPING
-#define Q_SHIFTING
-#define Q_JUMPING
-
-#elif defined(XOCHIP)
-#define Q_MEMORY
-
-#endif
-
 /*
  * Map accordingly to your desired key layout
  * 1 2 3 C
@@ -67,22 +33,44 @@ static const u8 FONT[] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-static void timer_tick(Chip8 *state);
+// moves bit i of a byte to byte 7 - i of a u64 and back, see chip8_pack_display
+#define PACK_MAGIC 0x8040201008040201ull
+#define PACK_LOW_BITS 0x0101010101010101ull
+
+static void step(Chip8 *state);
+static u32 run_plain(Chip8 *state, u32 budget);
+static u32 run_fused(Chip8 *state, u32 budget);
+static u32 run_debug(Chip8 *state, u32 budget, Chip8Core core);
+static void execute(Chip8 *state, u16 instr);
+static u32 execute_fused(Chip8 *state, u16 instr, u32 budget);
+static void fault(Chip8 *state, u8 reason);
+static u16 fetch(const Chip8 *state, u16 adr);
+static void draw_sprite(Chip8 *state, u16 VX, u16 VY, u16 N);
+static void load_gprs(Chip8 *state, u16 VX);
+static void mark_dirty(Chip8 *state, u16 adr, u16 len);
+static u32 rng_next(Chip8 *state);
 
 Chip8 *chip8_init() {
    Chip8 *state = calloc(1, sizeof(*state));
+   chip8_reset(state);
+   return state;
+}
+
+void chip8_reset(Chip8 *state) {
+   memset(state, 0, sizeof(*state));
 
    // init chip8 font (anywhere in the interpreter space, but commonly at FONT_ADR)
    memcpy(&state->RAM[FONT_ADR], &FONT, sizeof(FONT));
 
-   state->PREV_TIME = time_in_ms();
-
-   return state;
+   state->KEY_RELEASED = KEY_NONE;
+   chip8_seed(state, 1);
 }
 
 void chip8_terminate(Chip8 **state) {
-   if (*state)
+   if (*state) {
+      free((*state)->DBG);
       free(*state);
+   }
    state = NULL;
 }
 
@@ -90,11 +78,166 @@ void chip8_load_app(Chip8 *state, void *data, u32 size) {
    memcpy(&state->RAM[state->PC = PROGRAM_START_ADR], data, size);
 }
 
-void chip8_tick(Chip8 *state, u8 key_pressed, u8 key_released) {
+void chip8_set_host_keys(Chip8 *state, u8 key_pressed, u8 key_released) {
+   chip8_set_keypad(state, chip8_host_keypad(key_pressed),
+                    key_released < NUM_KEYS ? KEY_MAPPING[key_released] : KEY_NONE);
+}
+
+u16 chip8_host_keypad(u8 key_pressed) {
+   return key_pressed < NUM_KEYS ? 1 << KEY_MAPPING[key_pressed] : 0;
+}
+
+void chip8_seed(Chip8 *state, u32 seed) {
+   state->RNG = seed ? seed : 0x9E3779B9; // xorshift state must be non-zero
+}
+
+void chip8_set_keypad(Chip8 *state, u16 keys_down, u8 key_released) {
+   state->KEYS_DOWN = keys_down;
+   state->KEY_RELEASED = key_released;
+}
+
+u32 chip8_run(Chip8 *state, u32 budget) {
+   if (state->DBG && dbg_armed(state->DBG))
+      return run_debug(state, budget, run_plain);
+   return run_plain(state, budget);
+}
+
+u32 chip8_run_fused(Chip8 *state, u32 budget) {
+   if (state->DBG && dbg_armed(state->DBG))
+      return run_debug(state, budget, run_fused);
+   return run_fused(state, budget);
+}
+
+bool chip8_faulted(Chip8 *state) {
+   return state->FAULT;
+}
+
+const char *chip8_fault_reason(const Chip8 *state) {
+   switch (state->FAULT) {
+   case FAULT_NONE:
+      return "none";
+   case FAULT_STACK_FULL:
+      return "call with a full stack";
+   case FAULT_STACK_EMPTY:
+      return "return with an empty stack";
+   }
+   return "unknown";
+}
+
+void chip8_tick_timers(Chip8 *state) {
+   if (state->DELAY_TIMER >= 1)
+      state->DELAY_TIMER -= 1;
+   if (state->SOUND_TIMER >= 1)
+      state->SOUND_TIMER -= 1;
+   state->WAITED = 0;
+   state->POLL_PC = 0;
+}
+
+bool chip8_run_frame(Chip8 *state, u32 instructions) {
+   chip8_run(state, instructions);
+   chip8_tick_timers(state);
+   return state->SHOULD_DRAW;
+}
+
+u64 chip8_display_hash(const Chip8 *state) {
+   return hash_bytes(HASH_OFFSET, state->DISPLAY, sizeof(state->DISPLAY));
+}
+
+void chip8_pack_display(const Chip8 *state, u8 *bits) {
+   // eight pixels per byte, MSB first: one multiply gathers the low bit of eight bools (little endian host)
+   const bool *pixels = &state->DISPLAY[0][0];
+   for (u32 i = 0; i < DISPLAY_PACKED; ++i) {
+      u64 eight;
+      memcpy(&eight, &pixels[8 * i], sizeof(eight));
+      bits[i] = (eight * PACK_MAGIC) >> 56;
+   }
+}
+
+void chip8_unpack_display(Chip8 *state, const u8 *bits) {
+   bool *pixels = &state->DISPLAY[0][0];
+   for (u32 i = 0; i < DISPLAY_PACKED; ++i) {
+      const u64 eight = ((bits[i] * PACK_MAGIC) >> 7) & PACK_LOW_BITS;
+      memcpy(&pixels[8 * i], &eight, sizeof(eight));
+   }
+}
+
+static u32 rng_next(Chip8 *state) {
+   // xorshift32, kept per instance so headless runs are reproducible
+   u32 x = state->RNG;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   return state->RNG = x;
+}
+
+static void step(Chip8 *state) {
    // fetch
-   const u16 instr = ((u16)state->RAM[state->PC] << 8) | ((u16)state->RAM[state->PC + 1]);
+   const u16 instr = fetch(state, state->PC);
    state->PC += 2;
 
+   execute(state, instr);
+   if (state->FAULT)
+      state->PC -= 2; // stay on the faulting instruction
+}
+
+static u32 run_plain(Chip8 *state, u32 budget) {
+   bool drew = false;
+   u32 retired = 0;
+   for (; retired < budget && !state->FAULT; ++retired) {
+      step(state);
+      drew |= state->SHOULD_DRAW;
+   }
+   state->SHOULD_DRAW = drew; // latch any draw within the batch
+   return retired;
+}
+
+static u32 run_fused(Chip8 *state, u32 budget) {
+   bool drew = false;
+   u32 retired = 0;
+   while (retired < budget && !state->FAULT) {
+      const u16 instr = fetch(state, state->PC);
+
+      // only sequences starting with 1nnn, 7xNN, Annn or Fxnn are fused, everything else pays a single dispatch
+      u32 n = 0;
+      switch (instr & 0xF000) {
+      case 0x1000:
+      case 0x7000:
+      case 0xA000:
+      case 0xF000:
+         n = execute_fused(state, instr, budget - retired);
+         break;
+      }
+
+      if (n == 0) {
+         state->PC += 2;
+         execute(state, instr);
+         if (state->FAULT) {
+            state->PC -= 2;
+            break;
+         }
+         n = 1;
+      }
+      drew |= state->SHOULD_DRAW;
+      retired += n;
+   }
+   state->SHOULD_DRAW = drew;
+   return retired;
+}
+
+// instances with an armed debugger: blocks of straight code through core, the checks in between (debug.h)
+static u32 run_debug(Chip8 *state, u32 budget, Chip8Core core) {
+   bool drew = false;
+   u32 retired = 0;
+   while (retired < budget && !state->FAULT && !dbg_check(state->DBG, state)) {
+      const u32 block = dbg_block(state->DBG, state);
+      retired += core(state, block < budget - retired ? block : budget - retired);
+      drew |= state->SHOULD_DRAW;
+   }
+   state->SHOULD_DRAW = drew;
+   return retired;
+}
+
+static void execute(Chip8 *state, u16 instr) {
    const u16 op = instr & 0xF000;
    const u16 VX = (instr & 0x0F00) >> 8; // x-gpr index
    const u16 VY = (instr & 0x00F0) >> 4; // y-gpr index
@@ -114,7 +257,10 @@ void chip8_tick(Chip8 *state, u8 key_pressed, u8 key_released) {
          break;
       case 0x00EE: {
          u16 prev_adr = state->PC;
-         state->PC = adr_pop(&state->STACK);
+         if (!adr_pop(&state->STACK, &state->PC)) {
+            fault(state, FAULT_STACK_EMPTY);
+            break;
+         }
          d_printf(
              ("Instruction (0x%04hX): Returning from subroutine at 0x%04hX to 0x%04hX\n", instr, prev_adr, state->PC));
          break;
@@ -124,11 +270,16 @@ void chip8_tick(Chip8 *state, u8 key_pressed, u8 key_released) {
       break;
    }
    case 0x1000:
+      if (NNN == state->PC - 2)
+         state->WAITED |= WAIT_HALT;
       state->PC = NNN;
       // d_printf(("Instruction (%x): Set PC to (%x)\n", instr, NNN);
       break;
    case 0x2000:
-      adr_push(&state->STACK, state->PC); // save jump back adr
+      if (!adr_push(&state->STACK, state->PC)) { // save jump back adr
+         fault(state, FAULT_STACK_FULL);
+         break;
+      }
       state->PC = NNN;
       d_printf(("Instruction (0x%04hX): Calling subroutine at 0x%04hX\n", instr, state->PC));
       break;
@@ -273,72 +424,34 @@ void chip8_tick(Chip8 *state, u8 key_pressed, u8 key_released) {
       d_printf(("Instruction (0x%04hX): Jump to address 0x%04hX + 0x%04hX\n", instr, NNN, state->GPR[0]));
       break;
    case 0xC000:
-      state->GPR[VX] = (rand() % 255) & NN;
+      state->GPR[VX] = (rng_next(state) % 255) & NN;
       break;
-   case 0xD000: {
-      state->SHOULD_DRAW = true;
-      const u16 base_x = state->GPR[VX] % DISPLAY_WIDTH;
-      const u16 base_y = state->GPR[VY] % DISPLAY_HEIGHT;
-      state->GPR[0xF] = 0;
-      d_printf(("Instruction (0x%04hX): Drawing sprite with height %d (N) at (%d, %d) from GPR[%d] and GPR [%d]\n",
-                instr, N, base_x, base_y, VX, VY));
-
-      // For each row
-      for (u32 offset_y = 0; offset_y < N; ++offset_y) {
-         const u8 sprite_row = state->RAM[state->I + offset_y];
-         u16 y = (base_y + offset_y);
-
-// clip at borderj
-#ifdef Q_CLIPPING
-         if (y >= DISPLAY_HEIGHT)
-            break;
-#else
-         y %= DISPLAY_HEIGHT;
-#endif
-
-         // For each column
-         for (u8 offset_x = 0; offset_x < 8; ++offset_x) { // msb to lsb
-            u16 x = (base_x + offset_x);
-
-#ifdef Q_CLIPPING
-            if (x >= DISPLAY_WIDTH)
-               break;
-#else
-            x %= DISPLAY_WIDTH;
-#endif
-
-            const bool disp_pix_on = state->DISPLAY[y][x];
-            const bool sprite_pix_on = sprite_row & (1 << (7 - offset_x));
-
-            if (sprite_pix_on && disp_pix_on) {
-               state->DISPLAY[y][x] = false;
-               state->GPR[0xF] = 1;
-            } else if (sprite_pix_on && !disp_pix_on) {
-               state->DISPLAY[y][x] = true;
-            }
-         }
-      }
+   case 0xD000:
+      d_printf(("Instruction (0x%04hX): Drawing sprite with height %d (N) from GPR[%d] and GPR [%d]\n", instr, N, VX,
+                VY));
+      draw_sprite(state, VX, VY, N);
       break;
-   }
    case 0xE000: {
       switch (NN) {
       case 0x009E: {
-         const bool extra_cond = key_pressed < 16 && KEY_MAPPING[key_pressed] == state->GPR[VX];
-         state->KEYS[state->GPR[VX]] = extra_cond; // sync with direct input
+         const u8 key = state->GPR[VX] & 0xF; // only the low nibble selects a key
+         const bool extra_cond = (state->KEYS_DOWN >> key) & 1;
+         state->KEYS[key] = extra_cond; // sync with direct input
 
-         if (state->KEYS[state->GPR[VX]] || extra_cond) {
+         if (state->KEYS[key] || extra_cond) {
             state->PC += 2;
-            state->KEYS[state->GPR[VX]] = false; // reset
+            state->KEYS[key] = false; // reset
          }
          break;
       }
       case 0x00A1: {
-         const bool extra_cond = key_pressed < 16 && KEY_MAPPING[key_pressed] == state->GPR[VX];
-         state->KEYS[state->GPR[VX]] = extra_cond; // sync with direct input
+         const u8 key = state->GPR[VX] & 0xF;
+         const bool extra_cond = (state->KEYS_DOWN >> key) & 1;
+         state->KEYS[key] = extra_cond; // sync with direct input
 
-         if (!state->KEYS[state->GPR[VX]] && !extra_cond) {
+         if (!state->KEYS[key] && !extra_cond) {
             state->PC += 2;
-            state->KEYS[state->GPR[VX]] = false; // reset
+            state->KEYS[key] = false; // reset
          }
          break;
       }
@@ -349,15 +462,21 @@ void chip8_tick(Chip8 *state, u8 key_pressed, u8 key_released) {
       switch (NN) {
       case 0x0007:
          state->GPR[VX] = state->DELAY_TIMER;
+         // the same poll twice before the timer moved : whatever loop it sits in is waiting for it
+         if (state->DELAY_TIMER && state->POLL_PC == state->PC)
+            state->WAITED |= WAIT_TIMER;
+         state->POLL_PC = state->PC;
          d_printf(("Instruction (0x%04hX): GPR[%d] = %d (Delay Timer)\n", instr, VX, state->DELAY_TIMER));
          break;
       case 0x000A:
-         if (key_released < 16) {
-            state->GPR[VX] = KEY_MAPPING[key_released];
+         if (state->KEY_RELEASED < NUM_KEYS) {
+            state->GPR[VX] = state->KEY_RELEASED;
             state->KEYS[state->GPR[VX]] = true; // set key to true
-            d_printf(("key pressed: 0x%04hX, set to %d\n", state->GPR[VX], KEYS[state->GPR[VX]]));
+            state->KEY_RELEASED = KEY_NONE;     // a release is only seen once
+            d_printf(("key pressed: 0x%04hX, set to %d\n", state->GPR[VX], state->KEYS[state->GPR[VX]]));
          } else {
             state->PC -= 2; // wait if no keypress
+            state->WAITED |= WAIT_KEY;
             d_printf(("waiting for keypress..\n"));
          }
          break;
@@ -377,19 +496,22 @@ void chip8_tick(Chip8 *state, u8 key_pressed, u8 key_released) {
          state->I = FONT_ADR + state->GPR[VX] * FONT_STRIDE;
          break;
       case 0x0033: {
+         mark_dirty(state, state->I, 3);
          u8 div = 100;
          u8 val = state->GPR[VX];
          for (s32 i = 0; i < 3; ++i) {
-            state->RAM[state->I + i] = val / div;
-            val -= (state->RAM[state->I + i]) * div;
+            u8 *digit = &state->RAM[(state->I + i) % RAM_SIZE];
+            *digit = val / div;
+            val -= *digit * div;
             div /= 10;
          }
          assert(val == 0);
          break;
       }
       case 0x0055:
+         mark_dirty(state, state->I, VX + 1);
          for (size_t i = 0; i <= VX; ++i) // last included (through i+x)
-            state->RAM[state->I + i] = state->GPR[i];
+            state->RAM[(state->I + i) % RAM_SIZE] = state->GPR[i];
 #ifdef Q_MEMORY
          state->I += VX + 1;
 #endif
@@ -398,12 +520,7 @@ void chip8_tick(Chip8 *state, u8 key_pressed, u8 key_released) {
                    state->I, state->I, VX));
          break;
       case 0x0065:
-         for (size_t i = 0; i <= VX; ++i)
-            state->GPR[i] = state->RAM[state->I + i];
-#ifdef Q_MEMORY
-         state->I += VX + 1;
-#endif
-
+         load_gprs(state, VX);
          d_printf(("Instruction (0x%04hX): Saving [V0, V%d] <-- [RAM[0x%04hX], RAM[0x%04hX + %d]]\n", instr, VX,
                    state->I, state->I, VX));
          break;
@@ -415,36 +532,168 @@ void chip8_tick(Chip8 *state, u8 key_pressed, u8 key_released) {
       assert(false);
       break;
    }
+}
+
+/*
+ * Superinstructions: executes a recognised sequence starting at PC (instr) as one operation.
+ * Returns the number of instructions retired, 0 when nothing was fused.
+ * None of the fused sequences write RAM, so the instructions fetched up front stay valid,
+ * and the state afterwards is exactly what stepping them one by one would produce.
+ */
+static u32 execute_fused(Chip8 *state, u16 instr, u32 budget) {
+   const u16 pc = state->PC;
+   const u16 VX = (instr & 0x0F00) >> 8;
+
+   switch (instr & 0xF000) {
+   case 0x1000:
+      // 1nnn to itself : halt, nothing changes until the next frame at the earliest
+      if ((instr & 0x0FFF) != pc)
+         break;
+      state->SHOULD_DRAW = false;
+      state->WAITED |= WAIT_HALT;
+      return budget;
+   case 0x7000: {
+      // 7xNN, 3xNN : loop counter
+      if (budget < 2 || pc + 4 > RAM_SIZE)
+         break;
+      const u16 next = fetch(state, pc + 2);
+      if ((next & 0xFF00) != (0x3000 | (VX << 8)))
+         break;
+
+      state->GPR[VX] += instr & 0x00FF;
+      state->PC = pc + (state->GPR[VX] == (next & 0x00FF) ? 6 : 4);
+      state->SHOULD_DRAW = false;
+      return 2;
+   }
+   case 0xA000: {
+      if (budget < 2 || pc + 4 > RAM_SIZE)
+         break;
+      const u16 next = fetch(state, pc + 2);
+
+      // Annn, Dxyn : point at a sprite and draw it
+      if ((next & 0xF000) == 0xD000) {
+         state->I = instr & 0x0FFF;
+         state->PC = pc + 4;
+         draw_sprite(state, (next & 0x0F00) >> 8, (next & 0x00F0) >> 4, next & 0x000F);
+         return 2;
+      }
+      // Annn, Fx65 : point at a table and load it
+      if ((next & 0xF0FF) == 0xF065) {
+         state->I = instr & 0x0FFF;
+         state->PC = pc + 4;
+         state->SHOULD_DRAW = false;
+         load_gprs(state, (next & 0x0F00) >> 8);
+         return 2;
+      }
+      break;
+   }
+   case 0xF000:
+      // Fx0A without a released key : waits on itself for the rest of the batch
+      if ((instr & 0x00FF) == 0x0A) {
+         if (state->KEY_RELEASED < NUM_KEYS)
+            break;
+         state->SHOULD_DRAW = false;
+         state->WAITED |= WAIT_KEY;
+         return budget;
+      }
 
-   timer_tick(state);
+      // Fx07, 3x00, 1nnn (back to Fx07) : spin until the delay timer runs out
+      if ((instr & 0x00FF) != 0x07 || budget < 3 || pc + 6 > RAM_SIZE)
+         break;
+      if (fetch(state, pc + 2) != (0x3000 | (VX << 8)) || fetch(state, pc + 4) != (0x1000 | pc))
+         break;
+
+      state->GPR[VX] = state->DELAY_TIMER;
+      state->SHOULD_DRAW = false;
+      if (state->DELAY_TIMER == 0) {
+         state->POLL_PC = pc + 2; // as Fx07 leaves it
+         state->PC = pc + 6; // skips over the jump
+         return 2;
+      }
+
+      // timers only move between frames, so every remaining whole iteration is identical
+      // the reference sees a wait from the second poll at pc on, or the first after an earlier one
+      if (budget >= 6 || state->POLL_PC == pc + 2)
+         state->WAITED |= WAIT_TIMER;
+      state->POLL_PC = pc + 2;
+      return (budget / 3) * 3;
+   }
+
+   return 0;
 }
 
-bool chip8_should_draw(Chip8 *state) {
-   return state->SHOULD_DRAW;
+static void fault(Chip8 *state, u8 reason) {
+   state->FAULT = reason;
 }
 
-bool chip8_should_beep(Chip8 *state) {
-   if (state->SOUND_TIMER != 0)
-      return true;
-   return false;
+static u16 fetch(const Chip8 *state, u16 adr) {
+   // PC and I are 12 bits wide, wrap rather than access past RAM (I-indexed accesses too)
+   return ((u16)state->RAM[adr % RAM_SIZE] << 8) | ((u16)state->RAM[(adr + 1) % RAM_SIZE]);
 }
 
-void timer_tick(Chip8 *state) {
-   const u64 curr = time_in_ms();
-   const u64 diff = curr - state->PREV_TIME;
-   if (diff > ceilf(TIMER_THRESHOLD_MS)) {
-      if (state->DELAY_TIMER >= 1)
-         state->DELAY_TIMER -= 1;
-      if (state->SOUND_TIMER >= 1)
-         state->SOUND_TIMER -= 1;
-      state->PREV_TIME = curr;
+static void draw_sprite(Chip8 *state, u16 VX, u16 VY, u16 N) {
+   state->SHOULD_DRAW = true;
+   const u16 base_x = state->GPR[VX] % DISPLAY_WIDTH;
+   const u16 base_y = state->GPR[VY] % DISPLAY_HEIGHT;
+   state->GPR[0xF] = 0;
+
+   // For each row
+   for (u32 offset_y = 0; offset_y < N; ++offset_y) {
+      const u8 sprite_row = state->RAM[(state->I + offset_y) % RAM_SIZE];
+      u16 y = (base_y + offset_y);
+
+// clip at borderj
+#ifdef Q_CLIPPING
+      if (y >= DISPLAY_HEIGHT)
+         break;
+#else
+      y %= DISPLAY_HEIGHT;
+#endif
+
+      // For each column
+      for (u8 offset_x = 0; offset_x < 8; ++offset_x) { // msb to lsb
+         u16 x = (base_x + offset_x);
+
+#ifdef Q_CLIPPING
+         if (x >= DISPLAY_WIDTH)
+            break;
+#else
+         x %= DISPLAY_WIDTH;
+#endif
+
+         const bool disp_pix_on = state->DISPLAY[y][x];
+         const bool sprite_pix_on = sprite_row & (1 << (7 - offset_x));
+
+         if (sprite_pix_on && disp_pix_on) {
+            state->DISPLAY[y][x] = false;
+            state->GPR[0xF] = 1;
+         } else if (sprite_pix_on && !disp_pix_on) {
+            state->DISPLAY[y][x] = true;
+         }
+      }
    }
 }
 
-bool chip8_sync_display() {
-#ifdef Q_DISP_WAIT
-   return true;
-#else
-   return false;
+static void load_gprs(Chip8 *state, u16 VX) {
+   for (size_t i = 0; i <= VX; ++i)
+      state->GPR[i] = state->RAM[(state->I + i) % RAM_SIZE];
+#ifdef Q_MEMORY
+   state->I += VX + 1;
 #endif
 }
+
+// a write of at most 16 bytes touches one page or two neighbours
+static void mark_dirty(Chip8 *state, u16 adr, u16 len) {
+   state->DIRTY |= 1 << (adr / RAM_PAGE) % RAM_PAGES;
+   state->DIRTY |= 1 << ((adr + len - 1) / RAM_PAGE) % RAM_PAGES;
+}
+
+bool chip8_should_draw(Chip8 *state) {
+   return state->SHOULD_DRAW;
+}
+
+bool chip8_should_beep(Chip8 *state) {
+   if (state->SOUND_TIMER != 0)
+      return true;
+   return false;
+}
@@ -4,8 +4,11 @@
 #include "types.h"
 
 #define RAM_SIZE 0x1000 // 4Kb (12 bits) addressable
+#define RAM_PAGE 0x100  // granularity of RAM write tracking
+#define RAM_PAGES (RAM_SIZE / RAM_PAGE)
 #define DISPLAY_WIDTH 64
 #define DISPLAY_HEIGHT 32
+#define DISPLAY_PACKED (DISPLAY_WIDTH * DISPLAY_HEIGHT / 8) // one bit per pixel, row-major, MSB first
 
 #define PIXEL_DIM 24        // (PIXEL_DIM x PIXEL_DIM) pixels represent native 1x1
 #define PIXEL_EDGE_OFFSET 1 // Offset colors from pixel edge for some better looking large blocks!
@@ -14,6 +17,16 @@
 #define PROGRAM_START_ADR 0x200
 
 #define NUM_GPRS 16
+#define NUM_KEYS 16
+#define KEY_NONE UINT8_MAX
+
+// how the program was seen waiting within a frame
+#define WAIT_TIMER 0x1 // polled the delay timer twice at the same Fx07 before it moved
+#define WAIT_KEY 0x2   // Fx0A without a released key
+#define WAIT_HALT 0x4  // jumped to itself
+
+// why execution stopped, reported by whoever runs the instance (chip8_fault_reason)
+enum { FAULT_NONE, FAULT_STACK_FULL, FAULT_STACK_EMPTY };
 
 typedef struct Chip8 {
    u16 PC;
@@ -25,21 +38,51 @@ typedef struct Chip8 {
    u8 SOUND_TIMER;
    u8 GPR[NUM_GPRS];
 
-   bool KEYS[16];
+   bool KEYS[NUM_KEYS];
+   u16 KEYS_DOWN;   // keypad bitmask held for this tick
+   u8 KEY_RELEASED; // keypad value released this tick (KEY_NONE otherwise), consumed by Fx0A
+   u32 RNG;
    bool SHOULD_DRAW;
-   u64 PREV_TIME;
+   u8 FAULT;   // FAULT_*, execution halts on the faulting instruction
+   u8 WAITED;   // WAIT_* seen since the last chip8_tick_timers
+   u16 POLL_PC; // Fx07 polled last since the timers moved, 0 for none
+   u16 DIRTY;   // bit per RAM_PAGE written by Fx33 / Fx55, cleared by whoever tracks them
+
+   struct Debugger *DBG; // attached debugger (debug.h), NULL otherwise
 
 } Chip8;
 
 Chip8 *chip8_init();
 void chip8_terminate(Chip8 **state);
+void chip8_reset(Chip8 *state); // power-on state, for instances not allocated by chip8_init
 
 void chip8_load_app(Chip8 *state, void *data, u32 size);
 
 bool chip8_should_draw(Chip8 *state);
 bool chip8_should_beep(Chip8 *state);
+bool chip8_faulted(Chip8 *state);
+const char *chip8_fault_reason(const Chip8 *state);
+
+void chip8_set_host_keys(Chip8 *state, u8 key_pressed, u8 key_released); // host key indices, through the key mapping
+u16 chip8_host_keypad(u8 key_pressed);                                   // keypad bitmask of a host key index
+
+/*
+ * Headless stepping, independent of the host clock.
+ * Keys are keypad values [0x0, 0xF] rather than host key indices.
+ */
+void chip8_seed(Chip8 *state, u32 seed);
+void chip8_set_keypad(Chip8 *state, u16 keys_down, u8 key_released);
+
+// An execution core runs budget instructions (fewer only on a fault or a debugger pause) and returns the number retired
+typedef u32 (*Chip8Core)(Chip8 *state, u32 budget);
+
+u32 chip8_run(Chip8 *state, u32 budget);       // reference core
+u32 chip8_run_fused(Chip8 *state, u32 budget); // fuses common instruction sequences into one dispatch
+void chip8_tick_timers(Chip8 *state);    // one 60 Hz timer decrement
+bool chip8_run_frame(Chip8 *state, u32 instructions);
 
-void chip8_tick(Chip8 *state, u8 key_pressed, u8 key_released);
-bool chip8_sync_display();
+u64 chip8_display_hash(const Chip8 *state);
+void chip8_pack_display(const Chip8 *state, u8 *bits);   // DISPLAY_PACKED bytes
+void chip8_unpack_display(Chip8 *state, const u8 *bits); // little endian host
 
 #endif
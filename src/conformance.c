@@ -0,0 +1,214 @@
+#include "chip8.h"
+#include "utils.h"
+#include <pthread.h>
+
+/*
+ * Headless conformance harness for the test suite in roms/tests.
+ *
+ * Each ROM runs for a fixed number of 60 Hz frames with scripted keypad input.
+ * The final framebuffer is hashed and compared against the golden hashes in GOLDEN_FILE.
+ *
+ * Usage: conformance [--update] [--dump] [dir]
+ *   --update : rewrite the golden file from the current results
+ *   --dump   : print each final framebuffer as text
+ */
+
+#ifndef CONFORMANCE_DIR
+#define CONFORMANCE_DIR "roms/tests" // assuming we are not in build dir
+#endif
+
+#define GOLDEN_FILE "golden.txt"
+#define MAX_PATH 512
+
+#define CONFORMANCE_IPF 12 // ~700 instructions per second, same as the app
+#define CONFORMANCE_SEED 1
+
+typedef struct ScriptedKey {
+   u32 frame; // first frame the key is held down
+   u32 hold;  // frames held before it is released
+   u8 key;    // keypad value [0x0, 0xF]
+} ScriptedKey;
+
+typedef struct ConformanceTest {
+   const char *rom;
+   u32 frames;
+   const ScriptedKey *script;
+   u32 script_len;
+
+   // filled in by the worker
+   Chip8 *state;
+   u64 hash;
+   bool loaded;
+} ConformanceTest;
+
+// 5-quirks: pick the CHIP-8 platform from the menu
+static const ScriptedKey QUIRKS_SCRIPT[] = {{.frame = 30, .hold = 4, .key = 0x1}};
+
+// 6-keypad: pick the Fx0A test, then press and release a key
+static const ScriptedKey KEYPAD_SCRIPT[] = {{.frame = 80, .hold = 4, .key = 0x3}, {.frame = 150, .hold = 4, .key = 0x5}};
+
+#define SCRIPT(s) s, sizeof(s) / sizeof(s[0])
+
+static ConformanceTest TESTS[] = {
+    {.rom = "1-chip8-logo.ch8", .frames = 60},
+    {.rom = "2-ibm-logo.ch8", .frames = 60},
+    {.rom = "3-corax+.ch8", .frames = 120},
+    {.rom = "4-flags.ch8", .frames = 240},
+    {.rom = "5-quirks.ch8", .frames = 600, SCRIPT(QUIRKS_SCRIPT)},
+    {.rom = "6-keypad.ch8", .frames = 240, SCRIPT(KEYPAD_SCRIPT)},
+};
+
+#define NUM_TESTS (sizeof(TESTS) / sizeof(TESTS[0]))
+
+static const char *g_dir = CONFORMANCE_DIR;
+
+static void *run_test(void *userdata);
+static bool read_golden(const char *rom, u64 *out_hash);
+static void write_golden();
+static void dump_display(const Chip8 *state);
+
+int main(int argc, char **argv) {
+   bool update = false;
+   bool dump = false;
+   for (s32 i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--update") == 0)
+         update = true;
+      else if (strcmp(argv[i], "--dump") == 0)
+         dump = true;
+      else
+         g_dir = argv[i];
+   }
+
+   const u64 time_beg = time_in_ns();
+
+   // one thread per ROM, they share nothing
+   pthread_t threads[NUM_TESTS];
+   for (u32 i = 0; i < NUM_TESTS; ++i)
+      pthread_create(&threads[i], NULL, run_test, &TESTS[i]);
+   for (u32 i = 0; i < NUM_TESTS; ++i)
+      pthread_join(threads[i], NULL);
+
+   const u64 time_diff_ns = time_in_ns() - time_beg;
+
+   u32 failures = 0;
+   for (u32 i = 0; i < NUM_TESTS; ++i) {
+      ConformanceTest *test = &TESTS[i];
+      if (!test->loaded) {
+         printf("MISSING %s/%s\n", g_dir, test->rom);
+         ++failures;
+         continue;
+      }
+
+      u64 golden = 0;
+      const bool has_golden = read_golden(test->rom, &golden);
+      if (update)
+         printf("UPDATE  %-20s 0x%016llX\n", test->rom, (unsigned long long)test->hash);
+      else if (!has_golden)
+         printf("NOGOLD  %-20s 0x%016llX\n", test->rom, (unsigned long long)test->hash);
+      else if (golden != test->hash)
+         printf("FAIL    %-20s 0x%016llX (expected 0x%016llX)\n", test->rom, (unsigned long long)test->hash,
+                (unsigned long long)golden);
+      else
+         printf("PASS    %-20s 0x%016llX\n", test->rom, (unsigned long long)test->hash);
+
+      if (!update && (!has_golden || golden != test->hash))
+         ++failures;
+
+      if (dump)
+         dump_display(test->state);
+   }
+
+   if (update)
+      write_golden();
+
+   printf("%u / %u passed in %.3f ms\n", (u32)NUM_TESTS - failures, (u32)NUM_TESTS, time_diff_ns / 1000000.0);
+
+   for (u32 i = 0; i < NUM_TESTS; ++i)
+      chip8_terminate(&TESTS[i].state);
+
+   return (update || failures == 0) ? 0 : 1;
+}
+
+static void *run_test(void *userdata) {
+   ConformanceTest *test = userdata;
+
+   char path[MAX_PATH];
+   snprintf(path, sizeof(path), "%s/%s", g_dir, test->rom);
+
+   u32 app_size = 0;
+   void *app = read_bin_file(path, &app_size);
+   if (!app)
+      return NULL;
+
+   test->state = chip8_init();
+   chip8_seed(test->state, CONFORMANCE_SEED);
+   chip8_load_app(test->state, app, app_size);
+   free(app);
+
+   for (u32 frame = 0; frame < test->frames; ++frame) {
+      u16 keys_down = 0;
+      u8 key_released = KEY_NONE;
+      for (u32 i = 0; i < test->script_len; ++i) {
+         const ScriptedKey *sk = &test->script[i];
+         if (frame >= sk->frame && frame < sk->frame + sk->hold)
+            keys_down |= 1 << sk->key;
+         else if (frame == sk->frame + sk->hold)
+            key_released = sk->key;
+      }
+
+      chip8_set_keypad(test->state, keys_down, key_released);
+      chip8_run_frame(test->state, CONFORMANCE_IPF);
+   }
+
+   test->hash = chip8_display_hash(test->state);
+   test->loaded = true;
+   return NULL;
+}
+
+static bool read_golden(const char *rom, u64 *out_hash) {
+   char path[MAX_PATH];
+   snprintf(path, sizeof(path), "%s/%s", g_dir, GOLDEN_FILE);
+
+   FILE *file = fopen(path, "r");
+   if (!file)
+      return false;
+
+   bool found = false;
+   unsigned long long hash = 0;
+   char name[MAX_PATH];
+   while (fscanf(file, "%llx %511s", &hash, name) == 2) {
+      if (strcmp(name, rom) == 0) {
+         *out_hash = hash;
+         found = true;
+         break;
+      }
+   }
+
+   fclose(file);
+   return found;
+}
+
+static void write_golden() {
+   char path[MAX_PATH];
+   snprintf(path, sizeof(path), "%s/%s", g_dir, GOLDEN_FILE);
+
+   FILE *file = fopen(path, "w");
+   if (!file) {
+      printf("Failed to write %s\n", path);
+      return;
+   }
+
+   for (u32 i = 0; i < NUM_TESTS; ++i) {
+      if (TESTS[i].loaded)
+         fprintf(file, "%016llX %s\n", (unsigned long long)TESTS[i].hash, TESTS[i].rom);
+   }
+   fclose(file);
+}
+
+static void dump_display(const Chip8 *state) {
+   for (s32 y = 0; y < DISPLAY_HEIGHT; ++y) {
+      for (s32 x = 0; x < DISPLAY_WIDTH; ++x)
+         putchar(state->DISPLAY[y][x] ? '#' : '.');
+      putchar('\n');
+   }
+}
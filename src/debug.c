@@ -0,0 +1,408 @@
+#include "debug.h"
+#include "analysis.h"
+
+#define REPL_LINE 128
+#define DUMP_DEFAULT_LEN 64
+#define DUMP_STRIDE 16
+#define DISASM_DEFAULT_LEN 8
+
+static const char *REASONS[] = {"", "attached", "breakpoint", "condition", "read watch", "write watch", "step", "user break"};
+static const char *OPS[] = {"==", "!=", "<", ">"};
+
+static u16 instr_at(const Chip8 *state, u16 adr);
+static bool pause_on(Debugger *dbg, DbgReason reason, u16 adr);
+static bool cond_holds(const Debugger *dbg, const Chip8 *state, u16 pc);
+static bool accesses(const Chip8 *state, u16 instr, u16 *out_adr, u16 *out_len, u8 *out_flag);
+static void set_flags(Debugger *dbg, u16 adr, u8 flags);
+static u16 scan_block(const Debugger *dbg, const Chip8 *state, u16 adr);
+static bool ends_block(u16 instr);
+static void print_regs(const Chip8 *state, FILE *out);
+static void print_stack(const Chip8 *state, FILE *out);
+static void print_mem(const Chip8 *state, u16 adr, u16 len, FILE *out);
+static void print_disasm(const Chip8 *state, u16 adr, u16 count, FILE *out);
+static void watch_code(Debugger *dbg, const Chip8 *state, FILE *out);
+static void print_list(const Debugger *dbg, FILE *out);
+static void print_help(FILE *out);
+
+Debugger *dbg_attach(Chip8 *state) {
+   if (!state->DBG) {
+      state->DBG = calloc(1, sizeof(*state->DBG));
+      dbg_pause(state->DBG, DBG_ATTACH, state->PC);
+   }
+   return state->DBG;
+}
+
+void dbg_detach(Chip8 *state) {
+   free(state->DBG);
+   state->DBG = NULL;
+}
+
+void dbg_pause(Debugger *dbg, DbgReason reason, u16 adr) {
+   dbg->paused = true;
+   dbg->stepping = false;
+   dbg->reason = reason;
+   dbg->hit_adr = adr;
+}
+
+bool dbg_paused(const Debugger *dbg) {
+   return dbg->paused;
+}
+
+const char *dbg_reason(DbgReason reason) {
+   return REASONS[reason];
+}
+
+void dbg_continue(Debugger *dbg, u32 steps) {
+   dbg->paused = false;
+   dbg->resume = true;
+   dbg->stepping = steps > 0;
+   dbg->steps_left = steps;
+}
+
+void dbg_set_break(Debugger *dbg, u16 adr, bool on) {
+   adr %= RAM_SIZE;
+   set_flags(dbg, adr, on ? dbg->FLAGS[adr] | DBG_BREAK : dbg->FLAGS[adr] & ~DBG_BREAK);
+}
+
+bool dbg_add_cond(Debugger *dbg, u16 adr, u8 reg, DbgOp op, u8 value) {
+   if (dbg->num_conds == DBG_MAX_CONDS || reg >= NUM_GPRS)
+      return false;
+
+   adr %= RAM_SIZE;
+   dbg->conds[dbg->num_conds++] = (DbgCond){.adr = adr, .reg = reg, .op = op, .value = value};
+   set_flags(dbg, adr, dbg->FLAGS[adr] | DBG_COND);
+   return true;
+}
+
+void dbg_set_watch(Debugger *dbg, u16 adr, u16 len, u8 flags, bool on) {
+   flags &= DBG_READ | DBG_WRITE;
+   for (u32 i = 0; i < len; ++i) {
+      const u16 a = (adr + i) % RAM_SIZE;
+      set_flags(dbg, a, on ? dbg->FLAGS[a] | flags : dbg->FLAGS[a] & ~flags);
+   }
+}
+
+void dbg_clear(Debugger *dbg) {
+   memset(dbg->FLAGS, 0, sizeof(dbg->FLAGS));
+   dbg->num_breaks = 0;
+   dbg->num_watches = 0;
+   dbg->num_conds = 0;
+   dbg->blocks_stale = true;
+}
+
+bool dbg_armed(Debugger *dbg) {
+   if (dbg->paused || dbg->stepping || dbg->num_breaks > 0 || dbg->num_watches > 0)
+      return true;
+   dbg->resume = false; // there is nothing at PC to skip over
+   return false;
+}
+
+bool dbg_check(Debugger *dbg, const Chip8 *state) {
+   if (dbg->paused)
+      return true;
+
+   const u16 pc = state->PC % RAM_SIZE;
+   if (dbg->stepping && dbg->steps_left-- == 0)
+      return pause_on(dbg, DBG_STEPPED, pc);
+
+   if (dbg->resume) {
+      dbg->resume = false;
+      return false;
+   }
+
+   const u8 flags = dbg->FLAGS[pc];
+   if (flags & DBG_BREAK)
+      return pause_on(dbg, DBG_HIT_BREAK, pc);
+   if ((flags & DBG_COND) && cond_holds(dbg, state, pc))
+      return pause_on(dbg, DBG_HIT_COND, pc);
+
+   if (dbg->num_watches > 0) {
+      u16 adr = 0;
+      u16 len = 0;
+      u8 flag = 0;
+      if (accesses(state, instr_at(state, pc), &adr, &len, &flag)) {
+         for (u16 i = 0; i < len; ++i) {
+            const u16 a = (adr + i) % RAM_SIZE;
+            if (dbg->FLAGS[a] & flag)
+               return pause_on(dbg, flag == DBG_READ ? DBG_HIT_READ : DBG_HIT_WRITE, a);
+         }
+      }
+   }
+   return false;
+}
+
+u32 dbg_block(Debugger *dbg, Chip8 *state) {
+   if (dbg->stepping)
+      return 1;
+
+   // new flags or new code, RAM written by the program or a debug client
+   if (dbg->blocks_stale || state->DIRTY) {
+      memset(dbg->BLOCKS, 0, sizeof(dbg->BLOCKS));
+      dbg->blocks_stale = false;
+      state->DIRTY = 0;
+   }
+   const u16 pc = state->PC % RAM_SIZE;
+   if (!dbg->BLOCKS[pc])
+      dbg->BLOCKS[pc] = scan_block(dbg, state, pc);
+   return dbg->BLOCKS[pc];
+}
+
+bool dbg_repl(Chip8 *state, FILE *in, FILE *out) {
+   Debugger *dbg = state->DBG;
+   fprintf(out, "[%s at 0x%03hX] PC 0x%03hX: %04hX\n", dbg_reason(dbg->reason), dbg->hit_adr, state->PC,
+           instr_at(state, state->PC));
+
+   char line[REPL_LINE];
+   while (dbg->paused) {
+      fprintf(out, "(dbg) ");
+      fflush(out);
+      if (!fgets(line, sizeof(line), in))
+         return false;
+
+      char cmd[16] = "";
+      char arg[4][16] = {"", "", "", ""};
+      const s32 n = sscanf(line, "%15s %15s %15s %15s %15s", cmd, arg[0], arg[1], arg[2], arg[3]);
+      const u16 adr = strtol(arg[0], NULL, 16) % RAM_SIZE; // when the first argument is an address
+
+      if (n <= 0 || strcmp(cmd, "s") == 0) {
+         // step, an empty line steps once as well
+         const s32 steps = n >= 2 ? strtol(arg[0], NULL, 0) : 1;
+         dbg_continue(dbg, steps > 0 ? steps : 1);
+      } else if (strcmp(cmd, "c") == 0) {
+         dbg_continue(dbg, 0);
+      } else if (strcmp(cmd, "b") == 0 && n == 2) {
+         dbg_set_break(dbg, adr, !(dbg->FLAGS[adr] & DBG_BREAK));
+      } else if (strcmp(cmd, "b") == 0 && n == 5) {
+         // b adr vX op value
+         u32 reg = 0;
+         s32 op = -1;
+         for (s32 i = 0; i < 4; ++i) {
+            if (strcmp(arg[2], OPS[i]) == 0)
+               op = i;
+         }
+         if (sscanf(arg[1], "%*[vV]%x", &reg) != 1 || op < 0 || !dbg_add_cond(dbg, adr, reg, op, strtol(arg[3], NULL, 0)))
+            fprintf(out, "usage: b adr vX ==|!=|<|> value (at most %d conditions)\n", DBG_MAX_CONDS);
+      } else if (strcmp(cmd, "w") == 0 && n >= 2) {
+         // w adr [len] [r|w|rw]
+         const u16 len = n >= 3 ? strtol(arg[1], NULL, 0) : 1;
+         const char *mode = n >= 4 ? arg[2] : "rw";
+         const u8 flags = (strchr(mode, 'r') ? DBG_READ : 0) | (strchr(mode, 'w') ? DBG_WRITE : 0);
+         dbg_set_watch(dbg, adr, len, flags, true);
+      } else if (strcmp(cmd, "d") == 0) {
+         dbg_clear(dbg);
+      } else if (strcmp(cmd, "l") == 0) {
+         print_list(dbg, out);
+      } else if (strcmp(cmd, "r") == 0) {
+         print_regs(state, out);
+      } else if (strcmp(cmd, "k") == 0) {
+         print_stack(state, out);
+      } else if (strcmp(cmd, "m") == 0) {
+         print_mem(state, n >= 2 ? adr : state->I, n >= 3 ? strtol(arg[1], NULL, 0) : DUMP_DEFAULT_LEN, out);
+      } else if (strcmp(cmd, "u") == 0) {
+         print_disasm(state, n >= 2 ? adr : state->PC, n >= 3 ? strtol(arg[1], NULL, 0) : DISASM_DEFAULT_LEN, out);
+      } else if (strcmp(cmd, "x") == 0) {
+         watch_code(dbg, state, out);
+      } else if (strcmp(cmd, "q") == 0) {
+         return false;
+      } else {
+         print_help(out);
+      }
+   }
+   return true;
+}
+
+static u16 instr_at(const Chip8 *state, u16 adr) {
+   return ((u16)state->RAM[adr % RAM_SIZE] << 8) | state->RAM[(adr + 1) % RAM_SIZE];
+}
+
+static bool pause_on(Debugger *dbg, DbgReason reason, u16 adr) {
+   dbg_pause(dbg, reason, adr);
+   return true;
+}
+
+static bool cond_holds(const Debugger *dbg, const Chip8 *state, u16 pc) {
+   for (u32 i = 0; i < dbg->num_conds; ++i) {
+      const DbgCond *c = &dbg->conds[i];
+      if (c->adr != pc)
+         continue;
+
+      const u8 v = state->GPR[c->reg];
+      switch (c->op) {
+      case DBG_EQ:
+         if (v == c->value)
+            return true;
+         break;
+      case DBG_NE:
+         if (v != c->value)
+            return true;
+         break;
+      case DBG_LT:
+         if (v < c->value)
+            return true;
+         break;
+      case DBG_GT:
+         if (v > c->value)
+            return true;
+         break;
+      }
+   }
+   return false;
+}
+
+// RAM bytes an instruction reads or writes through I, instruction fetches aside
+static bool accesses(const Chip8 *state, u16 instr, u16 *out_adr, u16 *out_len, u8 *out_flag) {
+   const u16 VX = (instr & 0x0F00) >> 8;
+   *out_adr = state->I;
+
+   if ((instr & 0xF000) == 0xD000) {
+      *out_len = instr & 0x000F;
+      *out_flag = DBG_READ;
+      return true;
+   }
+   if ((instr & 0xF000) != 0xF000)
+      return false;
+
+   switch (instr & 0x00FF) {
+   case 0x33:
+      *out_len = 3;
+      *out_flag = DBG_WRITE;
+      return true;
+   case 0x55:
+      *out_len = VX + 1;
+      *out_flag = DBG_WRITE;
+      return true;
+   case 0x65:
+      *out_len = VX + 1;
+      *out_flag = DBG_READ;
+      return true;
+   }
+   return false;
+}
+
+// the only place FLAGS change one address at a time, keeps the counts in line
+static void set_flags(Debugger *dbg, u16 adr, u8 flags) {
+   const u8 old = dbg->FLAGS[adr];
+   dbg->num_breaks += !(old & (DBG_BREAK | DBG_COND)) && (flags & (DBG_BREAK | DBG_COND));
+   dbg->num_breaks -= (old & (DBG_BREAK | DBG_COND)) && !(flags & (DBG_BREAK | DBG_COND));
+   dbg->num_watches += !(old & (DBG_READ | DBG_WRITE)) && (flags & (DBG_READ | DBG_WRITE));
+   dbg->num_watches -= (old & (DBG_READ | DBG_WRITE)) && !(flags & (DBG_READ | DBG_WRITE));
+   dbg->FLAGS[adr] = flags;
+   dbg->blocks_stale = true;
+}
+
+static u16 scan_block(const Debugger *dbg, const Chip8 *state, u16 adr) {
+   u16 instr = instr_at(state, adr);
+   u16 len = 1;
+   while (!ends_block(instr) && len < RAM_SIZE / 2) {
+      adr = (adr + 2) % RAM_SIZE;
+      instr = instr_at(state, adr);
+
+      u16 a, n;
+      u8 flag;
+      if ((dbg->FLAGS[adr] & (DBG_BREAK | DBG_COND)) || (dbg->num_watches > 0 && accesses(state, instr, &a, &n, &flag)))
+         break; // checked as the start of the next block
+      ++len;
+   }
+   return len;
+}
+
+// anything that may not fall through to the next instruction, and stores, which may change the code
+static bool ends_block(u16 instr) {
+   switch (instr & 0xF000) {
+   case 0x0000:
+      return instr == 0x00EE;
+   case 0x1000:
+   case 0x2000:
+   case 0x3000:
+   case 0x4000:
+   case 0x5000:
+   case 0x9000:
+   case 0xB000:
+   case 0xE000:
+      return true;
+   case 0xF000:
+      return (instr & 0x00FF) == 0x0A || (instr & 0x00FF) == 0x33 || (instr & 0x00FF) == 0x55;
+   }
+   return false;
+}
+
+static void print_regs(const Chip8 *state, FILE *out) {
+   fprintf(out, "PC 0x%03hX  I 0x%03hX  DT %d  ST %d  keys %04hX\n", state->PC, state->I, state->DELAY_TIMER,
+           state->SOUND_TIMER, state->KEYS_DOWN);
+   for (s32 i = 0; i < NUM_GPRS; ++i)
+      fprintf(out, "V%X %02X%s", i, state->GPR[i], i % 8 == 7 ? "\n" : "  ");
+}
+
+static void print_stack(const Chip8 *state, FILE *out) {
+   const AdrStack *stack = &state->STACK;
+   fprintf(out, "%d / %d entries\n", stack->head, MAX_ADR_STACK);
+   for (s32 i = stack->head - 1; i >= 0; --i)
+      fprintf(out, "  #%-3d 0x%03hX\n", i, stack->addresses[i]);
+}
+
+static void print_mem(const Chip8 *state, u16 adr, u16 len, FILE *out) {
+   for (u16 i = 0; i < len; ++i) {
+      if (i % DUMP_STRIDE == 0)
+         fprintf(out, "%s0x%03X:", i ? "\n" : "", (adr + i) % RAM_SIZE);
+      fprintf(out, " %02X", state->RAM[(adr + i) % RAM_SIZE]);
+   }
+   fprintf(out, "\n");
+}
+
+static void print_disasm(const Chip8 *state, u16 adr, u16 count, FILE *out) {
+   char text[32];
+   for (u16 i = 0; i < count; ++i, adr += 2) {
+      analysis_disasm(instr_at(state, adr), text, sizeof(text));
+      fprintf(out, "%s0x%03X: %04hX  %s\n", adr % RAM_SIZE == state->PC ? "> " : "  ", adr % RAM_SIZE,
+              instr_at(state, adr), text);
+   }
+}
+
+// write watchpoints on the code found statically in RAM as it is now, writes anywhere else never pause
+static void watch_code(Debugger *dbg, const Chip8 *state, FILE *out) {
+   Analysis *an = analysis_run(state->RAM, RAM_SIZE - PROGRAM_START_ADR);
+   if (!an)
+      return;
+
+   u32 bytes = 0;
+   for (u32 adr = 0; adr < RAM_SIZE; ++adr) {
+      if (analysis_is_code(an, adr)) {
+         dbg_set_watch(dbg, adr, 1, DBG_WRITE, true);
+         ++bytes;
+      }
+   }
+   fprintf(out, "watching writes to %u code bytes in %u blocks%s\n", bytes, an->num_blocks,
+           an->blind_writes ? "" : ", no store through a computed I");
+   analysis_terminate(&an);
+}
+
+static void print_list(const Debugger *dbg, FILE *out) {
+   for (u32 adr = 0; adr < RAM_SIZE; ++adr) {
+      const u8 f = dbg->FLAGS[adr];
+      if (f & DBG_BREAK)
+         fprintf(out, "break 0x%03X\n", adr);
+      if (f & (DBG_READ | DBG_WRITE))
+         fprintf(out, "watch 0x%03X %s%s\n", adr, f & DBG_READ ? "r" : "", f & DBG_WRITE ? "w" : "");
+   }
+   for (u32 i = 0; i < dbg->num_conds; ++i) {
+      const DbgCond *c = &dbg->conds[i];
+      fprintf(out, "cond  0x%03hX V%X %s %d\n", c->adr, c->reg, OPS[c->op], c->value);
+   }
+}
+
+static void print_help(FILE *out) {
+   fprintf(out, "s [n]                      step n instructions (empty line steps once)\n"
+                "c                          continue\n"
+                "b adr                      toggle a breakpoint\n"
+                "b adr vX ==|!=|<|> value   break at adr when the condition holds\n"
+                "w adr [len] [r|w|rw]       watch RAM reads and/or writes through I\n"
+                "d                          delete all breakpoints and watchpoints\n"
+                "l                          list breakpoints and watchpoints\n"
+                "r                          registers\n"
+                "k                          address stack\n"
+                "m [adr] [len]              dump memory, from I by default\n"
+                "u [adr] [n]                disassemble n instructions, from PC by default\n"
+                "x                          watch writes to code (self-modification), found by static analysis\n"
+                "q                          quit\n"
+                "addresses are hex, counts and values decimal or 0x-prefixed\n");
+}
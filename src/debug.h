@@ -0,0 +1,75 @@
+#ifndef _DEBUG
+#define _DEBUG
+#include "chip8.h"
+
+#define DBG_MAX_CONDS 16
+
+// per-address flags
+enum {
+   DBG_BREAK = 1 << 0, // break before executing the instruction here
+   DBG_COND = 1 << 1,  // break here when one of the conditions on this address holds
+   DBG_READ = 1 << 2,  // break before an instruction reads this byte (Dxyn, Fx65)
+   DBG_WRITE = 1 << 3, // break before an instruction writes this byte (Fx33, Fx55)
+};
+
+typedef enum DbgReason { DBG_NONE, DBG_ATTACH, DBG_HIT_BREAK, DBG_HIT_COND, DBG_HIT_READ, DBG_HIT_WRITE, DBG_STEPPED, DBG_USER } DbgReason;
+
+typedef enum DbgOp { DBG_EQ, DBG_NE, DBG_LT, DBG_GT } DbgOp;
+
+// break at adr when V[reg] op value
+typedef struct DbgCond {
+   u16 adr;
+   u8 reg;
+   DbgOp op;
+   u8 value;
+} DbgCond;
+
+/*
+ * Breakpoints and watchpoints for an instance, attached through Chip8.DBG.
+ *
+ * Detached instances pay one pointer check per run call, and so do attached ones while nothing is armed (no flags, not
+ * paused or stepping). Armed ones run straight blocks of code through the same core and check only at block starts.
+ * A block ends on a branch, skip, key wait or store, and before a flagged address or, while watchpoints exist, before
+ * an instruction that reads or writes through I. Block lengths are cached per start address until the flags change
+ * or RAM is written (Chip8.DIRTY, tracked by the debugger while attached).
+ */
+typedef struct Debugger {
+   u8 FLAGS[RAM_SIZE];
+   u32 num_breaks;       // addresses flagged DBG_BREAK or DBG_COND
+   u32 num_watches;      // addresses flagged DBG_READ or DBG_WRITE
+   u16 BLOCKS[RAM_SIZE]; // instructions from each address up to the next check, 0 until scanned
+   bool blocks_stale;
+   DbgCond conds[DBG_MAX_CONDS];
+   u32 num_conds;
+
+   bool paused;
+   bool resume; // the instruction at the paused PC runs once without checks
+   bool stepping;
+   u32 steps_left; // instructions left before pausing again while stepping
+   DbgReason reason;
+   u16 hit_adr; // PC, or the watched byte
+} Debugger;
+
+Debugger *dbg_attach(Chip8 *state); // starts paused
+void dbg_detach(Chip8 *state);
+
+void dbg_pause(Debugger *dbg, DbgReason reason, u16 adr);
+bool dbg_paused(const Debugger *dbg);
+const char *dbg_reason(DbgReason reason);
+void dbg_continue(Debugger *dbg, u32 steps); // steps 0 to run until the next hit
+
+void dbg_set_break(Debugger *dbg, u16 adr, bool on);
+bool dbg_add_cond(Debugger *dbg, u16 adr, u8 reg, DbgOp op, u8 value);
+void dbg_set_watch(Debugger *dbg, u16 adr, u16 len, u8 flags, bool on); // flags DBG_READ and/or DBG_WRITE
+void dbg_clear(Debugger *dbg);
+
+bool dbg_armed(Debugger *dbg); // false while nothing could stop the instance
+// called before the instruction at PC, true when it must not run yet
+bool dbg_check(Debugger *dbg, const Chip8 *state);
+// instructions from PC on that run before the next check, at least 1
+u32 dbg_block(Debugger *dbg, Chip8 *state);
+
+// reads commands until the instance should run again, false on quit
+bool dbg_repl(Chip8 *state, FILE *in, FILE *out);
+
+#endif
@@ -0,0 +1,324 @@
+#include "debug_server.h"
+#include "debug.h"
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define MAX_REPLIES_PER_REQUEST 24 // a snapshot is the largest
+#define READ_MAX 256               // bytes per read request, one reply line of hex
+#define SNAPSHOT_CHUNK 256
+
+static const char HEX[] = "0123456789ABCDEF";
+
+static void *serve(void *userdata);
+static bool handle(DebugServer *srv, Chip8 *state, const char *line);
+static bool reply(DebugServer *srv, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static Debugger *debugger(Chip8 *state);
+static void regs_text(const Chip8 *state, char *out, u32 size);
+static u32 display_text(const Chip8 *state, char *out);
+static u32 hex_text(const u8 *data, u32 len, char *out);
+
+DebugServer *server_init(const char *path) {
+   struct sockaddr_un addr = {.sun_family = AF_UNIX};
+   if (strlen(path) >= sizeof(addr.sun_path)) {
+      printf("Socket path too long: %s\n", path);
+      return NULL;
+   }
+   strcpy(addr.sun_path, path);
+
+   // a stale socket from an earlier run is replaced, anything else at path is left alone
+   struct stat st;
+   if (lstat(path, &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+         printf("%s exists and is not a socket\n", path);
+         return NULL;
+      }
+      unlink(path);
+   }
+
+   const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+      printf("Failed to listen on %s\n", path);
+      if (fd >= 0)
+         close(fd);
+      return NULL;
+   }
+
+   DebugServer *srv = calloc(1, sizeof(*srv));
+   srv->listen_fd = fd;
+   strcpy(srv->path, path);
+   spsc_init(&srv->requests, SERVER_CMD_QUEUE, sizeof(ServerMsg));
+   spsc_init(&srv->replies, SERVER_REPLY_QUEUE, sizeof(ServerMsg));
+
+   pthread_create(&srv->thread, NULL, serve, srv);
+   return srv;
+}
+
+void server_terminate(DebugServer **srv) {
+   if (*srv) {
+      __atomic_store_n(&(*srv)->stop, true, __ATOMIC_RELEASE);
+      pthread_join((*srv)->thread, NULL);
+      close((*srv)->listen_fd);
+      unlink((*srv)->path);
+      spsc_terminate(&(*srv)->requests);
+      spsc_terminate(&(*srv)->replies);
+      free(*srv);
+   }
+   *srv = NULL;
+}
+
+bool server_poll(DebugServer *srv, Chip8 *state) {
+   const bool paused = state->DBG && dbg_paused(state->DBG);
+   if (paused && !srv->was_paused) {
+      if (!reply(srv, "stopped %s 0x%03hX", dbg_reason(state->DBG->reason), state->DBG->hit_adr))
+         return false; // retried on the next poll
+   }
+
+   // requests stay queued until their replies are sure to fit
+   bool changed = false;
+   ServerMsg msg;
+   while (spsc_space(&srv->replies) >= MAX_REPLIES_PER_REQUEST && spsc_pop(&srv->requests, &msg))
+      changed |= handle(srv, state, msg.text);
+
+   srv->was_paused = state->DBG && dbg_paused(state->DBG);
+   return changed;
+}
+
+void server_frame(DebugServer *srv, const Chip8 *state) {
+   srv->frame++;
+   if (!srv->subscribed)
+      return;
+
+   ServerMsg msg;
+   const u32 len = snprintf(msg.text, sizeof(msg.text), "frame %u ", srv->frame);
+   msg.text[len + display_text(state, &msg.text[len])] = '\0';
+   if (!spsc_push(&srv->replies, &msg))
+      srv->frames_dropped++; // client is behind, the loop does not wait for it
+}
+
+static void *serve(void *userdata) {
+   DebugServer *srv = userdata;
+   int client = -1;
+   char buf[SERVER_CMD_LEN];
+   u32 len = 0;
+   bool hangup = false;
+
+   ServerMsg msg;
+   while (!__atomic_load_n(&srv->stop, __ATOMIC_ACQUIRE)) {
+      struct pollfd pfd = {.fd = client >= 0 ? client : srv->listen_fd, .events = POLLIN};
+      const int ready = poll(&pfd, 1, SERVER_POLL_MS);
+
+      if (ready > 0 && client < 0) {
+         client = accept(srv->listen_fd, NULL, NULL);
+         len = 0;
+      } else if (ready > 0) {
+         const ssize_t n = read(client, &buf[len], sizeof(buf) - 1 - len);
+         if (n <= 0) {
+            close(client);
+            client = -1;
+            hangup = true;
+         } else {
+            len += n;
+            buf[len] = '\0';
+
+            // one request per line
+            char *line = buf;
+            for (char *nl; (nl = strchr(line, '\n')); line = nl + 1) {
+               *nl = '\0';
+               snprintf(msg.text, sizeof(msg.text), "%s", line);
+               if (!spsc_push(&srv->requests, &msg))
+                  send(client, "err busy\n", 9, MSG_NOSIGNAL);
+            }
+            len -= line - buf;
+            memmove(buf, line, len);
+            if (len == sizeof(buf) - 1) {
+               send(client, "err line too long\n", 18, MSG_NOSIGNAL);
+               len = 0;
+            }
+         }
+      }
+
+      // frames stop once nobody reads them
+      if (hangup) {
+         memset(&msg, 0, sizeof(msg));
+         strcpy(msg.text, "unsubscribe");
+         hangup = !spsc_push(&srv->requests, &msg);
+      }
+
+      while (spsc_pop(&srv->replies, &msg)) {
+         if (client < 0)
+            continue;
+         const u32 n = strlen(msg.text);
+         msg.text[n] = '\n';
+         if (send(client, msg.text, n + 1, MSG_NOSIGNAL) < 0) {
+            close(client);
+            client = -1;
+            hangup = true;
+         }
+      }
+   }
+
+   if (client >= 0)
+      close(client);
+   return NULL;
+}
+
+// true when the request changed the instance
+static bool handle(DebugServer *srv, Chip8 *state, const char *line) {
+   char cmd[16] = "";
+   char arg0[16] = "";
+   char arg1[SERVER_CMD_LEN] = "";
+   const s32 n = sscanf(line, "%15s %15s %255s", cmd, arg0, arg1);
+   const u16 adr = strtoul(arg0, NULL, 16) % RAM_SIZE; // when the first argument is an address
+
+   if (n <= 0) {
+      reply(srv, "err empty");
+   } else if (strcmp(cmd, "regs") == 0) {
+      char text[SERVER_REPLY_LEN];
+      regs_text(state, text, sizeof(text));
+      reply(srv, "ok %s", text);
+   } else if (strcmp(cmd, "set") == 0 && n == 3) {
+      const u32 value = strtoul(arg1, NULL, 16);
+      u32 reg = 0;
+      if (strcmp(arg0, "pc") == 0)
+         state->PC = value % RAM_SIZE;
+      else if (strcmp(arg0, "i") == 0)
+         state->I = value;
+      else if (strcmp(arg0, "dt") == 0)
+         state->DELAY_TIMER = value;
+      else if (strcmp(arg0, "st") == 0)
+         state->SOUND_TIMER = value;
+      else if (sscanf(arg0, "v%x", &reg) == 1 && reg < NUM_GPRS)
+         state->GPR[reg] = value;
+      else {
+         reply(srv, "err unknown register %s", arg0);
+         return false;
+      }
+      reply(srv, "ok");
+      return true;
+   } else if (strcmp(cmd, "read") == 0 && n == 3) {
+      u32 len = strtoul(arg1, NULL, 10);
+      len = len > READ_MAX ? READ_MAX : len;
+
+      u8 bytes[READ_MAX];
+      for (u32 i = 0; i < len; ++i)
+         bytes[i] = state->RAM[(adr + i) % RAM_SIZE];
+
+      char text[SERVER_REPLY_LEN];
+      text[hex_text(bytes, len, text)] = '\0';
+      reply(srv, "ok %s", text);
+   } else if (strcmp(cmd, "write") == 0 && n == 3) {
+      const u32 len = strlen(arg1) / 2;
+      for (u32 i = 0; i < len; ++i) {
+         const char pair[3] = {arg1[2 * i], arg1[2 * i + 1], '\0'};
+         state->RAM[(adr + i) % RAM_SIZE] = strtoul(pair, NULL, 16);
+         state->DIRTY |= 1 << (adr + i) % RAM_SIZE / RAM_PAGE;
+      }
+      reply(srv, "ok %u", len);
+      return true;
+   } else if (strcmp(cmd, "break") == 0 && n >= 2) {
+      dbg_set_break(debugger(state), adr, true);
+      reply(srv, "ok");
+   } else if (strcmp(cmd, "unbreak") == 0 && n >= 2) {
+      dbg_set_break(debugger(state), adr, false);
+      reply(srv, "ok");
+   } else if ((strcmp(cmd, "watch") == 0 || strcmp(cmd, "unwatch") == 0) && n == 3) {
+      // flags after the length, read and write when left out
+      char mode[4] = "rw";
+      sscanf(line, "%*s %*s %*s %3s", mode);
+      const u8 flags = (strchr(mode, 'r') ? DBG_READ : 0) | (strchr(mode, 'w') ? DBG_WRITE : 0);
+      dbg_set_watch(debugger(state), adr, strtoul(arg1, NULL, 10), flags, cmd[0] == 'w');
+      reply(srv, "ok");
+   } else if (strcmp(cmd, "clear") == 0) {
+      if (state->DBG)
+         dbg_clear(state->DBG);
+      reply(srv, "ok");
+   } else if (strcmp(cmd, "pause") == 0) {
+      dbg_pause(debugger(state), DBG_USER, state->PC);
+      reply(srv, "ok 0x%03hX", state->PC);
+   } else if (strcmp(cmd, "continue") == 0) {
+      if (state->DBG)
+         dbg_continue(state->DBG, 0);
+      reply(srv, "ok");
+   } else if (strcmp(cmd, "step") == 0) {
+      const s32 steps = n >= 2 ? atoi(arg0) : 1;
+      dbg_continue(debugger(state), steps > 0 ? steps : 1);
+      reply(srv, "ok");
+   } else if (strcmp(cmd, "status") == 0) {
+      if (state->DBG && dbg_paused(state->DBG))
+         reply(srv, "ok paused %s 0x%03hX", dbg_reason(state->DBG->reason), state->DBG->hit_adr);
+      else
+         reply(srv, "ok %s", state->FAULT ? "faulted" : "running");
+   } else if (strcmp(cmd, "snapshot") == 0) {
+      char text[SERVER_REPLY_LEN];
+      regs_text(state, text, sizeof(text));
+      reply(srv, "regs %s", text);
+
+      u32 len = snprintf(text, sizeof(text), "stack %d", state->STACK.head);
+      for (s32 i = 0; i < state->STACK.head && len + 6 < sizeof(text); ++i)
+         len += snprintf(&text[len], sizeof(text) - len, " %03hX", state->STACK.addresses[i]);
+      reply(srv, "%s", text);
+
+      for (u32 a = 0; a < RAM_SIZE; a += SNAPSHOT_CHUNK) {
+         len = snprintf(text, sizeof(text), "ram %03X ", a);
+         text[len + hex_text(&state->RAM[a], SNAPSHOT_CHUNK, &text[len])] = '\0';
+         reply(srv, "%s", text);
+      }
+
+      text[display_text(state, text)] = '\0';
+      reply(srv, "display %s", text);
+      reply(srv, "ok");
+   } else if (strcmp(cmd, "subscribe") == 0) {
+      srv->subscribed = true;
+      reply(srv, "ok");
+   } else if (strcmp(cmd, "unsubscribe") == 0) {
+      srv->subscribed = false;
+      reply(srv, "ok");
+   } else if (strcmp(cmd, "detach") == 0) {
+      dbg_detach(state);
+      reply(srv, "ok");
+   } else {
+      reply(srv, "err unknown request: %s", line);
+   }
+   return false;
+}
+
+static bool reply(DebugServer *srv, const char *fmt, ...) {
+   ServerMsg msg;
+   va_list args;
+   va_start(args, fmt);
+   vsnprintf(msg.text, sizeof(msg.text), fmt, args);
+   va_end(args);
+   return spsc_push(&srv->replies, &msg);
+}
+
+// attaching for breakpoints must not stop a running instance
+static Debugger *debugger(Chip8 *state) {
+   if (!state->DBG)
+      dbg_continue(dbg_attach(state), 0);
+   return state->DBG;
+}
+
+static void regs_text(const Chip8 *state, char *out, u32 size) {
+   char v[2 * NUM_GPRS + 1];
+   v[hex_text(state->GPR, NUM_GPRS, v)] = '\0';
+   snprintf(out, size, "pc=%03hX i=%03hX dt=%02X st=%02X sp=%d keys=%04hX v=%s", state->PC, state->I,
+            state->DELAY_TIMER, state->SOUND_TIMER, state->STACK.head, state->KEYS_DOWN, v);
+}
+
+// one bit per pixel, row-major, most significant bit first
+static u32 display_text(const Chip8 *state, char *out) {
+   u8 packed[DISPLAY_PACKED];
+   chip8_pack_display(state, packed);
+   return hex_text(packed, sizeof(packed), out);
+}
+
+static u32 hex_text(const u8 *data, u32 len, char *out) {
+   for (u32 i = 0; i < len; ++i) {
+      out[2 * i] = HEX[data[i] >> 4];
+      out[2 * i + 1] = HEX[data[i] & 0xF];
+   }
+   return 2 * len;
+}
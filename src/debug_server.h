@@ -0,0 +1,56 @@
+#ifndef _DEBUG_SERVER
+#define _DEBUG_SERVER
+#include "chip8.h"
+#include "spsc.h"
+#include <pthread.h>
+
+#define SERVER_CMD_LEN 256   // longest request line
+#define SERVER_REPLY_LEN 640 // longest reply line, fits 256 bytes of hex
+#define SERVER_CMD_QUEUE 64
+#define SERVER_REPLY_QUEUE 256
+#define SERVER_POLL_MS 2
+
+/*
+ * Debug server for external tools, on a Unix domain socket.
+ *
+ * A thread owns the socket and talks a line protocol with one client at a time. Requests reach the emulation loop
+ * through one SPSC queue and replies, stop events and frames go back through another, so the loop never waits on the
+ * client: it drains requests in server_poll, and frames are dropped when the client falls behind.
+ *
+ * Requests (addresses and values hex, counts decimal), answered with "ok ..." or "err ...":
+ *   regs | set pc|i|dt|st|v0..vf value | read adr len | write adr hexbytes
+ *   break adr | unbreak adr | watch adr len r|w|rw | unwatch adr len | clear
+ *   pause | continue | step [n] | status | snapshot | subscribe | unsubscribe | detach
+ * Events: "stopped reason adr" when the debugger pauses, "frame n hexpixels" while subscribed.
+ */
+
+typedef struct ServerMsg {
+   char text[SERVER_REPLY_LEN];
+} ServerMsg;
+
+typedef struct DebugServer {
+   pthread_t thread;
+   int listen_fd;
+   char path[108]; // sun_path
+   bool stop;      // atomic, set on terminate
+
+   SpscQueue requests; // server thread -> emulation loop
+   SpscQueue replies;  // emulation loop -> server thread
+
+   // emulation loop side
+   bool subscribed;
+   bool was_paused;
+   u32 frame;
+   u64 frames_dropped;
+} DebugServer;
+
+DebugServer *server_init(const char *path);
+void server_terminate(DebugServer **srv);
+
+// emulation loop: handle pending requests against the instance, cheap when there are none
+// true when one of them changed it, so the display is presented again
+bool server_poll(DebugServer *srv, Chip8 *state);
+// emulation loop: after the display changed, hands it to a subscribed client
+void server_frame(DebugServer *srv, const Chip8 *state);
+
+#endif
@@ -0,0 +1,164 @@
+#include "env.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define SHM_SLOT_OFFSET ENV_SLOT_ALIGN // header padded to one slot alignment
+
+static Chip8Env *create(u32 count, void *app, u32 size, const EnvConfig *config, EnvSlot *slots);
+static void run_step(Chip8Env *env, EnvSlot *slot, u16 action, u32 frames);
+
+u64 env_slots_size(u32 count) {
+   return (u64)count * sizeof(EnvSlot);
+}
+
+Chip8Env *env_init(u32 count, void *app, u32 size, const EnvConfig *config, void *memory) {
+   if (count == 0 || size > RAM_SIZE - PROGRAM_START_ADR)
+      return NULL;
+
+   void *heap = NULL;
+   if (!memory) {
+      if (posix_memalign(&heap, ENV_SLOT_ALIGN, env_slots_size(count)) != 0)
+         return NULL;
+      memory = heap;
+   } else if ((uintptr_t)memory % ENV_SLOT_ALIGN != 0) {
+      printf("Env memory must be aligned to %d bytes\n", ENV_SLOT_ALIGN);
+      return NULL;
+   }
+
+   Chip8Env *env = create(count, app, size, config, memory);
+   env->heap = heap;
+   return env;
+}
+
+Chip8Env *env_init_shm(u32 count, void *app, u32 size, const EnvConfig *config, const char *name) {
+   if (count == 0 || size > RAM_SIZE - PROGRAM_START_ADR || strlen(name) >= sizeof(((Chip8Env *)0)->shm_name))
+      return NULL;
+
+   // never attach to (and truncate) an object someone else is using
+   const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+   if (fd < 0) {
+      printf("Failed to create shared memory %s, or it exists already\n", name);
+      return NULL;
+   }
+
+   const u64 map_size = SHM_SLOT_OFFSET + env_slots_size(count);
+   void *shm = MAP_FAILED;
+   if (ftruncate(fd, map_size) == 0)
+      shm = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+
+   if (shm == MAP_FAILED) {
+      printf("Failed to map shared memory %s\n", name);
+      shm_unlink(name);
+      return NULL;
+   }
+
+   // readers in other processes find the slots through the header
+   EnvShmHeader *header = shm;
+   header->magic = ENV_SHM_MAGIC;
+   header->count = count;
+   header->slot_offset = SHM_SLOT_OFFSET;
+   header->slot_size = sizeof(EnvSlot);
+   header->display_offset = offsetof(EnvSlot, state) + offsetof(Chip8, DISPLAY);
+   header->reward_offset = offsetof(EnvSlot, reward);
+   header->done_offset = offsetof(EnvSlot, done);
+   header->truncated_offset = offsetof(EnvSlot, truncated);
+
+   Chip8Env *env = create(count, app, size, config, (EnvSlot *)((u8 *)shm + SHM_SLOT_OFFSET));
+   env->shm = shm;
+   env->shm_size = map_size;
+   strcpy(env->shm_name, name);
+   return env;
+}
+
+void env_terminate(Chip8Env **env) {
+   if (*env) {
+      if ((*env)->shm) {
+         munmap((*env)->shm, (*env)->shm_size);
+         shm_unlink((*env)->shm_name);
+      }
+      free((*env)->heap);
+      free((*env)->app);
+      free(*env);
+   }
+   *env = NULL;
+}
+
+void env_reset(Chip8Env *env, u32 index, u32 seed) {
+   EnvSlot *slot = &env->slots[index];
+   chip8_reset(&slot->state);
+   chip8_seed(&slot->state, seed);
+   chip8_load_app(&slot->state, env->app, env->app_size);
+
+   slot->reward = 0;
+   slot->done = false;
+   slot->truncated = false;
+   slot->keys_down = 0;
+   slot->frame = 0;
+   slot->seed = seed;
+}
+
+void env_reset_all(Chip8Env *env, u32 seed) {
+   for (u32 k = 0; k < env->count; ++k)
+      env_reset(env, k, seed + k);
+}
+
+void env_step(Chip8Env *env, u32 index, u16 action, u32 frames) {
+   run_step(env, &env->slots[index], action, frames);
+}
+
+void env_step_all(Chip8Env *env, const u16 *actions, u32 frames) {
+   for (u32 k = 0; k < env->count; ++k) {
+      EnvSlot *slot = &env->slots[k];
+      // seeds stay distinct across environments and episodes
+      if (slot->done || slot->truncated)
+         env_reset(env, k, slot->seed + env->count);
+      run_step(env, slot, actions[k], frames);
+   }
+}
+
+const bool *env_observation(const Chip8Env *env, u32 index) {
+   return &env->slots[index].state.DISPLAY[0][0];
+}
+
+static Chip8Env *create(u32 count, void *app, u32 size, const EnvConfig *config, EnvSlot *slots) {
+   Chip8Env *env = calloc(1, sizeof(*env));
+   env->count = count;
+   if (config)
+      env->config = *config;
+   if (env->config.ipf == 0)
+      env->config.ipf = ENV_DEFAULT_IPF;
+
+   // kept for resets, the slot RAM is overwritten by the app
+   env->app = malloc(size);
+   memcpy(env->app, app, size);
+   env->app_size = size;
+
+   env->slots = slots;
+   env_reset_all(env, 1);
+   return env;
+}
+
+static void run_step(Chip8Env *env, EnvSlot *slot, u16 action, u32 frames) {
+   const EnvConfig *config = &env->config;
+   Chip8 *state = &slot->state;
+
+   // a key held last step and not this one is released, Fx0A waits on that
+   const u16 released = slot->keys_down & ~action;
+   chip8_set_keypad(state, action, released ? __builtin_ctz(released) : KEY_NONE);
+   slot->keys_down = action;
+
+   slot->reward = 0;
+   for (u32 f = 0; f < frames && !slot->done && !slot->truncated; ++f) {
+      chip8_run_fused(state, config->ipf);
+      chip8_tick_timers(state);
+      state->KEY_RELEASED = KEY_NONE; // a release lasts one frame
+      ++slot->frame;
+
+      if (config->reward)
+         slot->reward += config->reward(state, config->userdata);
+      slot->done = state->FAULT || (config->done && config->done(state, config->userdata));
+      slot->truncated = config->max_frames && slot->frame >= config->max_frames;
+   }
+}
@@ -0,0 +1,84 @@
+#ifndef _ENV
+#define _ENV
+#include "chip8.h"
+
+#define ENV_DEFAULT_IPF 12
+#define ENV_SHM_MAGIC 0x38504843 // "CHP8"
+#define ENV_SLOT_ALIGN 64
+
+/*
+ * Gym-style stepping of one ROM in many environments, for driving it from agents.
+ *
+ * A step holds an action (keypad bitmask) for a number of 60 Hz frames and runs the fused core with no host pacing.
+ * Observations are not copied out: each environment's Chip8 instance lives in its slot, so the framebuffer is read in
+ * place from the slot memory. That memory is allocated here, provided by the caller, or a POSIX shared-memory
+ * segment another process maps by name.
+ */
+
+typedef f32 (*EnvRewardFn)(const Chip8 *state, void *userdata); // called after every frame, summed over the step
+typedef bool (*EnvDoneFn)(const Chip8 *state, void *userdata);  // called after every frame, ends the episode
+
+typedef struct EnvConfig {
+   u32 ipf;        // instructions per frame, ENV_DEFAULT_IPF when 0
+   u32 max_frames; // episode is truncated after this many frames, 0 for no limit
+   EnvRewardFn reward;
+   EnvDoneFn done;
+   void *userdata;
+} EnvConfig;
+
+typedef struct EnvSlot {
+   Chip8 state; // observation is state.DISPLAY, one bool per pixel
+   f32 reward;  // summed over the frames of the last step
+   bool done;   // done hook fired or the core faulted
+   bool truncated;
+   u16 keys_down; // action of the last step, to derive key releases
+   u32 frame;     // frames into the episode
+   u32 seed;
+} __attribute__((aligned(ENV_SLOT_ALIGN))) EnvSlot;
+
+// start of a shared-memory segment, slots follow at slot_offset
+typedef struct EnvShmHeader {
+   u32 magic;
+   u32 count;
+   u32 slot_offset;
+   u32 slot_size;
+   u32 display_offset; // within a slot
+   u32 reward_offset;
+   u32 done_offset;
+   u32 truncated_offset;
+} EnvShmHeader;
+
+typedef struct Chip8Env {
+   u32 count;
+   EnvConfig config;
+   EnvSlot *slots;
+
+   u8 *app;
+   u32 app_size;
+
+   // what to release on terminate
+   void *heap;
+   void *shm;
+   u64 shm_size;
+   char shm_name[64];
+} Chip8Env;
+
+u64 env_slots_size(u32 count); // bytes needed for caller-provided memory
+
+// memory is count slots aligned to ENV_SLOT_ALIGN, or NULL to allocate them
+Chip8Env *env_init(u32 count, void *app, u32 size, const EnvConfig *config, void *memory);
+// slots in a new shared-memory object name (e.g. "/chip8-env"), fails when it exists already
+Chip8Env *env_init_shm(u32 count, void *app, u32 size, const EnvConfig *config, const char *name);
+void env_terminate(Chip8Env **env);
+
+void env_reset(Chip8Env *env, u32 index, u32 seed);
+void env_reset_all(Chip8Env *env, u32 seed); // environment k gets seed + k
+
+// hold the action for frames frames, stopping early when the episode ends
+void env_step(Chip8Env *env, u32 index, u16 action, u32 frames);
+// one action per environment; environments that ended in the previous step are reset first with a fresh seed
+void env_step_all(Chip8Env *env, const u16 *actions, u32 frames);
+
+const bool *env_observation(const Chip8Env *env, u32 index); // DISPLAY_HEIGHT rows of DISPLAY_WIDTH
+
+#endif
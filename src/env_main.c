@@ -0,0 +1,91 @@
+#include "env.h"
+#include "utils.h"
+
+/*
+ * Steps many environments of one ROM with random actions and reports the per-step cost,
+ * as an agent loop would see it.
+ *
+ * Usage: envbench [--envs N] [--steps S] [--frames F] [--ipf K] [--shm name] rom
+ *   --shm : keep the environments in the named shared-memory object while running
+ */
+
+#define DEFAULT_ENVS 64
+#define DEFAULT_STEPS 1000
+#define DEFAULT_FRAMES 4 // frame skip, each action is held this long
+
+// one point for every frame the ROM drew in, just so the hook has a cost
+static f32 reward_drew(const Chip8 *state, void *userdata) {
+   (void)userdata;
+   return state->SHOULD_DRAW ? 1.0f : 0.0f;
+}
+
+int main(int argc, char **argv) {
+   u32 envs = DEFAULT_ENVS;
+   u32 steps = DEFAULT_STEPS;
+   u32 frames = DEFAULT_FRAMES;
+   EnvConfig config = {.reward = reward_drew};
+   const char *shm = NULL;
+   const char *rom = NULL;
+
+   for (s32 i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--envs") == 0 && i + 1 < argc)
+         envs = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+         steps = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+         frames = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc)
+         config.ipf = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc)
+         shm = argv[++i];
+      else
+         rom = argv[i];
+   }
+
+   if (!rom || envs == 0) {
+      printf("Usage: envbench [--envs N] [--steps S] [--frames F] [--ipf K] [--shm name] rom\n");
+      return 1;
+   }
+
+   u32 app_size = 0;
+   void *app = read_bin_file((char *)rom, &app_size);
+   if (!app) {
+      printf("MISSING %s\n", rom);
+      return 1;
+   }
+
+   Chip8Env *env = shm ? env_init_shm(envs, app, app_size, &config, shm) : env_init(envs, app, app_size, &config, NULL);
+   free(app);
+   if (!env)
+      return 1;
+
+   u16 *actions = calloc(envs, sizeof(*actions));
+   u32 rng = 1;
+   f64 reward = 0;
+   u32 episodes = 0;
+
+   const u64 time_beg = time_in_ns();
+   for (u32 s = 0; s < steps; ++s) {
+      for (u32 k = 0; k < envs; ++k) {
+         rng ^= rng << 13;
+         rng ^= rng >> 17;
+         rng ^= rng << 5;
+         actions[k] = rng % 4 == 0 ? 1 << (rng >> 8) % NUM_KEYS : 0;
+      }
+      env_step_all(env, actions, frames);
+
+      for (u32 k = 0; k < envs; ++k) {
+         reward += env->slots[k].reward;
+         episodes += env->slots[k].done || env->slots[k].truncated;
+      }
+   }
+   const u64 time_diff_ns = time_in_ns() - time_beg;
+
+   printf("%u envs x %u steps x %u frames: %.3f us per vector step, %.0f ns per env step\n", envs, steps, frames,
+          time_diff_ns / 1000.0 / steps, (f64)time_diff_ns / steps / envs);
+   printf("reward %.0f, %u episodes ended\n", reward, episodes);
+
+   free(actions);
+   env_terminate(&env);
+   return 0;
+}
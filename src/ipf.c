@@ -0,0 +1,266 @@
+#include "ipf.h"
+#include "utils.h"
+#include <sys/stat.h>
+
+#define CALIB_SEED 1
+#define CALIB_PRESS_EVERY 40 // frames between scripted key presses
+#define CALIB_PRESS_HOLD 6
+#define CALIB_POLL_GAP 32 // most instructions between two polls of a wait loop
+#define LINE_LEN (IPF_PROFILE_NAME_LEN + 64)
+#define MIN_LINES 64 // ipf_save buffer, doubled as the file grows
+
+static u32 busy_trimmed(const u32 *hist, u32 trim);
+static bool parse_line(const char *line, IpfProfile *profile);
+static void format_line(char *line, const IpfProfile *profile);
+
+u64 ipf_rom_hash(const void *app, u32 size) {
+   return hash_bytes(HASH_OFFSET, app, size);
+}
+
+bool ipf_calibrate(const void *app, u32 size, const char *name, IpfProfile *profile) {
+   Chip8 *state = chip8_init();
+   chip8_seed(state, CALIB_SEED);
+   chip8_load_app(state, (void *)app, size);
+
+   // busy instructions of the frames that waited on the timer, [IPF_PROBE] for frames that waited on their last one
+   u32 *hist = calloc(IPF_PROBE + 1, sizeof(*hist));
+   u32 frames = 0, timer_frames = 0, stuck_frames = 0, draw_frames = 0;
+   u64 busy_instrs = 0, delay_instrs = 0; // delay loops are paced by instruction count
+   u32 rng = CALIB_SEED;
+   u8 key = 0;
+
+   for (; frames < IPF_CALIB_FRAMES && !state->FAULT; ++frames) {
+      // press a pseudo random key now and then, enough to get past title screens and menus
+      const u32 phase = frames % CALIB_PRESS_EVERY;
+      if (phase == 0) {
+         rng ^= rng << 13, rng ^= rng >> 17, rng ^= rng << 5;
+         key = rng % NUM_KEYS;
+      }
+      chip8_set_keypad(state, phase < CALIB_PRESS_HOLD ? 1 << key : 0, phase == CALIB_PRESS_HOLD ? key : KEY_NONE);
+
+      // one instruction at a time until the first wait, whatever is left of the frame is fused
+      u32 busy = 0;
+      bool drew = false, timer_wait = false;
+      u16 poll_pc = 0;
+      u32 poll_at = 0;
+      bool touched = false; // drew or wrote RAM since the last poll
+      while (busy < IPF_PROBE && !timer_wait && !(state->WAITED & (WAIT_KEY | WAIT_HALT)) && !state->FAULT) {
+         const u16 pc = state->PC;
+         const u16 instr = (state->RAM[pc % RAM_SIZE] << 8) | state->RAM[(pc + 1) % RAM_SIZE];
+         const u8 dt = state->DELAY_TIMER;
+         busy += chip8_run(state, 1);
+         drew |= state->SHOULD_DRAW;
+
+         if ((instr & 0xF000) == 0x7000) {
+            const u16 next = (state->RAM[(pc + 2) % RAM_SIZE] << 8) | state->RAM[(pc + 3) % RAM_SIZE];
+            const u16 jump = (state->RAM[(pc + 4) % RAM_SIZE] << 8) | state->RAM[(pc + 5) % RAM_SIZE];
+            const bool skip = (next & 0xF000) == 0x3000 || (next & 0xF000) == 0x4000;
+            if (skip && (next & 0x0F00) == (instr & 0x0F00) && jump == (0x1000 | pc))
+               delay_instrs += 3; // 7xNN, 3xNN or 4xNN, 1nnn
+         }
+         // stricter than Chip8.WAITED: a loop that does real work between its polls, like moving a piece while a
+         // key is held, is not waiting yet
+         if ((instr & 0xF0FF) == 0xF007) {
+            timer_wait = dt && pc == poll_pc && busy - poll_at <= CALIB_POLL_GAP && !touched;
+            poll_pc = pc, poll_at = busy, touched = false;
+         } else if (instr == 0x00E0 || (instr & 0xF000) == 0xD000 || (instr & 0xF0FF) == 0xF033 ||
+                    (instr & 0xF0FF) == 0xF055) {
+            touched = true;
+         }
+      }
+      chip8_run_fused(state, IPF_PROBE - busy);
+      drew |= state->SHOULD_DRAW;
+
+      const bool stuck = state->WAITED & (WAIT_KEY | WAIT_HALT);
+      if (timer_wait) {
+         ++timer_frames;
+         ++hist[busy];
+      } else if (stuck) {
+         ++stuck_frames; // title screens and game over, they say nothing about pacing
+      }
+      draw_frames += drew;
+      busy_instrs += busy;
+
+      chip8_tick_timers(state);
+   }
+
+   const bool faulted = state->FAULT;
+   chip8_terminate(&state);
+   if (faulted && frames < IPF_FRAME_RATE) {
+      free(hist);
+      printf("%s faulted after %u frames, not calibrated\n", name, frames);
+      return false;
+   }
+
+   memset(profile, 0, sizeof(*profile));
+   profile->hash = ipf_rom_hash(app, size);
+   profile->wait_share = (f32)timer_frames / frames;
+   profile->draw_rate = (f32)draw_frames * IPF_FRAME_RATE / frames;
+   snprintf(profile->name, sizeof(profile->name), "%s", name);
+
+   const u32 active = frames - stuck_frames;
+   profile->synced = timer_frames > 0 && timer_frames * 100 >= active * IPF_SYNC_PERCENT &&
+                     delay_instrs * 100 < busy_instrs * IPF_DELAY_PERCENT;
+   if (profile->synced) {
+      const u32 busy = busy_trimmed(hist, IPF_BUSY_TRIM);
+      const u32 ipf = busy + busy / 4 + 1;
+      profile->ipf = ipf < IPF_MIN ? IPF_MIN : ipf > IPF_MAX ? IPF_MAX : ipf;
+   }
+
+   free(hist);
+   return true;
+}
+
+bool ipf_load(const char *path, u64 hash, IpfProfile *profile) {
+   FILE *file = fopen(path, "r");
+   if (!file)
+      return false;
+
+   bool found = false;
+   char line[LINE_LEN];
+   while (!found && fgets(line, sizeof(line), file))
+      found = parse_line(line, profile) && profile->hash == hash;
+
+   fclose(file);
+   return found;
+}
+
+bool ipf_save(const char *path, const IpfProfile *profile) {
+   // keep every other line, in order
+   char(*lines)[LINE_LEN] = NULL;
+   u32 count = 0, capacity = 0;
+   bool replaced = false;
+
+   FILE *file = fopen(path, "r");
+   for (;;) {
+      // room for the next line, or the new profile after the last one
+      if (count == capacity) {
+         capacity = capacity ? 2 * capacity : MIN_LINES;
+         char(*grown)[LINE_LEN] = realloc(lines, (u64)capacity * LINE_LEN);
+         if (!grown) {
+            printf("Failed to allocate %u profile lines, %s left as it was\n", capacity, path);
+            free(lines);
+            if (file)
+               fclose(file);
+            return false;
+         }
+         lines = grown;
+      }
+      if (!file || !fgets(lines[count], LINE_LEN, file))
+         break;
+      ++count;
+   }
+   if (file)
+      fclose(file);
+
+   IpfProfile other;
+   for (u32 i = 0; i < count; ++i) {
+      if (parse_line(lines[i], &other) && other.hash == profile->hash) {
+         format_line(lines[i], profile);
+         replaced = true;
+      }
+   }
+   if (!replaced)
+      format_line(lines[count++], profile);
+
+   if (!(file = fopen(path, "w"))) {
+      printf("Failed to write %s\n", path);
+      free(lines);
+      return false;
+   }
+   for (u32 i = 0; i < count; ++i) {
+      fputs(lines[i], file);
+      if (i + 1 == count && !strchr(lines[i], '\n'))
+         fputc('\n', file); // a last line without one, longer lines come in several pieces
+   }
+   fclose(file);
+   free(lines);
+   return true;
+}
+
+bool ipf_cache_path(char *path, u32 len) {
+   const char *cache = getenv("XDG_CACHE_HOME");
+   const char *home = getenv("HOME");
+   u32 n = 0;
+   if (cache && cache[0] == '/')
+      n = snprintf(path, len, "%s/%s", cache, IPF_CACHE_FILE);
+   else if (home && home[0])
+      n = snprintf(path, len, "%s/.cache/%s", home, IPF_CACHE_FILE);
+   if (n == 0 || n >= len)
+      return false;
+
+   // every directory up to the file
+   for (char *slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+      *slash = '\0';
+      mkdir(path, 0755);
+      *slash = '/';
+   }
+   return true;
+}
+
+void ipf_adapt_init(IpfAdapt *adapt, const IpfProfile *profile) {
+   memset(adapt, 0, sizeof(*adapt));
+   if (profile) {
+      adapt->base = adapt->current = profile->ipf;
+      adapt->synced = profile->synced && profile->ipf;
+   }
+}
+
+u32 ipf_next(IpfAdapt *adapt) {
+   if (adapt->base)
+      return adapt->current;
+
+   adapt->carry += IPF_DEFAULT_IPS;
+   const u32 ipf = adapt->carry / IPF_FRAME_RATE;
+   adapt->carry %= IPF_FRAME_RATE;
+   return ipf;
+}
+
+void ipf_frame_done(IpfAdapt *adapt, u8 waited) {
+   if (!adapt->synced)
+      return;
+
+   // a frame that never waited did not get through its work, level loads and the like
+   if (!waited) {
+      const u32 grown = adapt->current + adapt->current / 2;
+      adapt->current = grown > IPF_MAX ? IPF_MAX : grown;
+   } else {
+      adapt->current -= (adapt->current - adapt->base + 3) / 4;
+   }
+}
+
+// the busiest frame once the trim busiest are left out, the least busy one when there are no more
+static u32 busy_trimmed(const u32 *hist, u32 trim) {
+   u32 least = 0;
+   u32 seen = 0;
+   for (s32 busy = IPF_PROBE; busy >= 0; --busy) {
+      if (!hist[busy])
+         continue;
+      seen += hist[busy];
+      least = busy;
+      if (seen > trim)
+         return busy;
+   }
+   return least;
+}
+
+static bool parse_line(const char *line, IpfProfile *profile) {
+   unsigned long long hash = 0;
+   char mode[8];
+   s32 name_at = 0;
+   memset(profile, 0, sizeof(*profile));
+   if (sscanf(line, "%llx %u %7s %f %f %n", &hash, &profile->ipf, mode, &profile->wait_share, &profile->draw_rate,
+              &name_at) != 5)
+      return false;
+
+   profile->hash = hash;
+   profile->synced = strcmp(mode, "timer") == 0;
+   snprintf(profile->name, sizeof(profile->name), "%s", &line[name_at]);
+   profile->name[strcspn(profile->name, "\n")] = '\0';
+   return true;
+}
+
+static void format_line(char *line, const IpfProfile *profile) {
+   snprintf(line, LINE_LEN, "%016llX %u %s %.2f %.1f %s\n", (unsigned long long)profile->hash, profile->ipf,
+            profile->synced ? "timer" : "free", profile->wait_share, profile->draw_rate, profile->name);
+}
@@ -0,0 +1,72 @@
+#ifndef _IPF
+#define _IPF
+#include "chip8.h"
+
+#define IPF_DEFAULT_IPS 700 // instructions per second of unprofiled ROMs
+#define IPF_FRAME_RATE 60
+#define IPF_DEFAULT_IPF ((IPF_DEFAULT_IPS + IPF_FRAME_RATE / 2) / IPF_FRAME_RATE) // 12, for fixed budgets
+#define IPF_MIN 8
+#define IPF_MAX 1000
+#define IPF_PROBE IPF_MAX        // instructions a calibration frame may take
+#define IPF_CALIB_FRAMES 1800    // 30 emulated seconds
+#define IPF_SYNC_PERCENT 50      // of the frames not stuck on a key or a halt must wait on the timer
+#define IPF_BUSY_TRIM 8          // busiest waiting frames left out, level loads and other one-off work
+#define IPF_DELAY_PERCENT 1      // of the work spent in counting delay loops makes a ROM free running
+#define IPF_PROFILE_NAME_LEN 128
+#define IPF_CACHE_FILE "cchip8/ipf.txt" // under $XDG_CACHE_HOME, or ~/.cache
+
+/*
+ * Per-ROM instructions per frame.
+ *
+ * ROMs that pace themselves by spinning on the delay timer need enough instructions per frame to finish a frame's work
+ * before they start waiting, anything on top is spent waiting. Too few and they stutter, too many and the host spins
+ * with them. Calibration runs the ROM headless with scripted key presses, measures the work done per frame before it
+ * is first seen polling an unchanged timer and takes the busiest frame with some margin, once the few busiest ones
+ * (IPF_BUSY_TRIM) are left out as one-off work. At runtime the budget of those ROMs grows while frames end without a
+ * wait (Chip8.WAITED) and settles back on the profile once they wait.
+ *
+ * ROMs that never wait on the timer run as fast as they are given instructions, nothing can be measured about their
+ * intended speed, so they keep IPF_DEFAULT_IPS unless the profile is edited by hand. So do ROMs that wait on the
+ * timer but also pace parts of themselves with counting delay loops (7xNN, 3xNN, 1nnn), Tetris moving pieces.
+ *
+ * Profiles are lines of a text file keyed by ROM hash:
+ *   HASH IPF timer|free WAIT_SHARE DRAWS/S name
+ * IPF 0 means the default rate. Other lines (comments, blank) are kept as they are when a profile is saved.
+ * The app looks in the user's cache first and stores what it calibrates there, the shipped file is only written by
+ * the calibrate tool.
+ */
+
+typedef struct IpfProfile {
+   u64 hash; // ipf_rom_hash
+   u32 ipf;  // 0 for IPF_DEFAULT_IPS
+   bool synced;
+   f32 wait_share; // frames seen waiting on the timer
+   f32 draw_rate;  // frames drawing per second
+   char name[IPF_PROFILE_NAME_LEN];
+} IpfProfile;
+
+// frame to frame budget of a running ROM
+typedef struct IpfAdapt {
+   u32 base;    // from the profile, 0 for the default rate
+   u32 current; // drifts above base while synced frames do not fit
+   u32 carry;   // keeps IPF_DEFAULT_IPS exact with whole instructions per frame
+   bool synced;
+} IpfAdapt;
+
+u64 ipf_rom_hash(const void *app, u32 size); // FNV-1a
+
+// runs the ROM headless from power-on, false when it faults before a profile could be made
+bool ipf_calibrate(const void *app, u32 size, const char *name, IpfProfile *profile);
+
+// profile of hash from path, false when there is none
+bool ipf_load(const char *path, u64 hash, IpfProfile *profile);
+// adds or replaces the profile's line in path
+bool ipf_save(const char *path, const IpfProfile *profile);
+// IPF_CACHE_FILE in the user's cache directory, created if needed, false when there is no home to put it in
+bool ipf_cache_path(char *path, u32 len);
+
+void ipf_adapt_init(IpfAdapt *adapt, const IpfProfile *profile); // NULL for the default rate
+u32 ipf_next(IpfAdapt *adapt);                                    // instructions for the next frame
+void ipf_frame_done(IpfAdapt *adapt, u8 waited);                  // Chip8.WAITED before the timers ticked
+
+#endif
@@ -0,0 +1,144 @@
+#include "lockstep.h"
+
+static void record(Lockstep *ls);
+
+void lockstep_init(Lockstep *ls, Chip8Core core, u32 check_every, void *app, u32 size, u32 seed) {
+   memset(ls, 0, sizeof(*ls));
+   ls->core = core;
+   ls->check_every = check_every ? check_every : 1;
+   ls->next_check = ls->check_every;
+
+   ls->ref = chip8_init();
+   ls->cand = chip8_init();
+   chip8_seed(ls->ref, seed);
+   chip8_seed(ls->cand, seed);
+   chip8_load_app(ls->ref, app, size);
+   chip8_load_app(ls->cand, app, size);
+}
+
+void lockstep_terminate(Lockstep *ls) {
+   chip8_terminate(&ls->ref);
+   chip8_terminate(&ls->cand);
+}
+
+bool lockstep_run_frame(Lockstep *ls, u16 keys_down, u8 key_released, u32 instructions) {
+   if (ls->diverged || ls->faulted)
+      return false;
+
+   chip8_set_keypad(ls->ref, keys_down, key_released);
+   chip8_set_keypad(ls->cand, keys_down, key_released);
+
+   u32 remaining = instructions;
+   while (remaining > 0) {
+      // the candidate may retire several instructions at once, the reference catches up one by one,
+      // and neither runs past the next check
+      const u64 until_check = ls->next_check - ls->retired;
+      const u32 budget = until_check < remaining ? until_check : remaining;
+      const u32 retired = ls->core(ls->cand, budget);
+      assert(retired <= budget);
+
+      for (u32 i = 0; i < retired; ++i) {
+         record(ls);
+         chip8_run(ls->ref, 1);
+         ++ls->retired;
+      }
+      remaining -= retired;
+
+      if (ls->cand->FAULT || ls->ref->FAULT) {
+         // the candidate stopped on its faulting instruction, see if the reference faults on it too
+         if (ls->cand->FAULT && !ls->ref->FAULT) {
+            record(ls);
+            chip8_run(ls->ref, 1);
+         }
+         ls->faulted = true;
+         lockstep_check(ls);
+         return false;
+      }
+
+      if (ls->retired >= ls->next_check) {
+         if (!lockstep_check(ls))
+            return false;
+         while (ls->next_check <= ls->retired)
+            ls->next_check += ls->check_every;
+      }
+   }
+
+   chip8_tick_timers(ls->ref);
+   chip8_tick_timers(ls->cand);
+   return true;
+}
+
+bool lockstep_check(Lockstep *ls) {
+   ls->diverged = !lockstep_equal(ls->ref, ls->cand);
+   return !ls->diverged;
+}
+
+void lockstep_dump(const Lockstep *ls, FILE *out) {
+   fprintf(out, "Divergence after %llu instructions (ref / candidate):\n", (unsigned long long)ls->retired);
+   lockstep_dump_diff(ls->ref, ls->cand, out);
+
+   fprintf(out, "Last reference instructions:\n");
+   const u32 count = ls->history_head < LOCKSTEP_HISTORY ? ls->history_head : LOCKSTEP_HISTORY;
+   for (u32 i = ls->history_head - count; i != ls->history_head; ++i) {
+      const LockstepInstr *entry = &ls->history[i % LOCKSTEP_HISTORY];
+      fprintf(out, "  #%-8llu 0x%04hX: %04hX\n", (unsigned long long)entry->count, entry->PC, entry->instr);
+   }
+}
+
+bool lockstep_equal(const Chip8 *a, const Chip8 *b) {
+   bool same = a->PC == b->PC && a->I == b->I && a->DELAY_TIMER == b->DELAY_TIMER &&
+               a->SOUND_TIMER == b->SOUND_TIMER && a->RNG == b->RNG && a->FAULT == b->FAULT &&
+               a->STACK.head == b->STACK.head && a->KEYS_DOWN == b->KEYS_DOWN && a->KEY_RELEASED == b->KEY_RELEASED &&
+               a->WAITED == b->WAITED && a->POLL_PC == b->POLL_PC;
+   same = same && memcmp(a->KEYS, b->KEYS, sizeof(a->KEYS)) == 0;
+   same = same && memcmp(a->GPR, b->GPR, sizeof(a->GPR)) == 0;
+   same = same && memcmp(a->STACK.addresses, b->STACK.addresses, a->STACK.head * sizeof(a->STACK.addresses[0])) == 0;
+   same = same && memcmp(a->RAM, b->RAM, sizeof(a->RAM)) == 0;
+   same = same && memcmp(a->DISPLAY, b->DISPLAY, sizeof(a->DISPLAY)) == 0;
+   return same;
+}
+
+void lockstep_dump_diff(const Chip8 *a, const Chip8 *b, FILE *out) {
+   if (a->PC != b->PC)
+      fprintf(out, "  PC:          0x%04hX / 0x%04hX\n", a->PC, b->PC);
+   if (a->I != b->I)
+      fprintf(out, "  I:           0x%04hX / 0x%04hX\n", a->I, b->I);
+   for (s32 i = 0; i < NUM_GPRS; ++i) {
+      if (a->GPR[i] != b->GPR[i])
+         fprintf(out, "  V[%X]:        %d / %d\n", i, a->GPR[i], b->GPR[i]);
+   }
+   if (a->DELAY_TIMER != b->DELAY_TIMER)
+      fprintf(out, "  Delay Timer: %d / %d\n", a->DELAY_TIMER, b->DELAY_TIMER);
+   if (a->SOUND_TIMER != b->SOUND_TIMER)
+      fprintf(out, "  Sound Timer: %d / %d\n", a->SOUND_TIMER, b->SOUND_TIMER);
+   if (a->FAULT != b->FAULT)
+      fprintf(out, "  Fault:       %d / %d\n", a->FAULT, b->FAULT);
+   if (a->RNG != b->RNG)
+      fprintf(out, "  RNG:         0x%08X / 0x%08X\n", a->RNG, b->RNG);
+   if (a->KEYS_DOWN != b->KEYS_DOWN || memcmp(a->KEYS, b->KEYS, sizeof(a->KEYS)) != 0)
+      fprintf(out, "  Keys:        0x%04X / 0x%04X\n", a->KEYS_DOWN, b->KEYS_DOWN);
+   if (a->KEY_RELEASED != b->KEY_RELEASED)
+      fprintf(out, "  Released:    0x%02X / 0x%02X\n", a->KEY_RELEASED, b->KEY_RELEASED);
+   if (a->WAITED != b->WAITED)
+      fprintf(out, "  Waited:      0x%X / 0x%X\n", a->WAITED, b->WAITED);
+   if (a->POLL_PC != b->POLL_PC)
+      fprintf(out, "  Poll PC:     0x%04hX / 0x%04hX\n", a->POLL_PC, b->POLL_PC);
+   if (a->STACK.head != b->STACK.head ||
+       memcmp(a->STACK.addresses, b->STACK.addresses, a->STACK.head * sizeof(a->STACK.addresses[0])) != 0)
+      fprintf(out, "  Stack:       depth %d / %d\n", a->STACK.head, b->STACK.head);
+   for (u32 adr = 0; adr < RAM_SIZE; ++adr) {
+      if (a->RAM[adr] != b->RAM[adr])
+         fprintf(out, "  RAM[0x%03X]:  0x%02X / 0x%02X\n", adr, a->RAM[adr], b->RAM[adr]);
+   }
+   if (memcmp(a->DISPLAY, b->DISPLAY, sizeof(a->DISPLAY)) != 0)
+      fprintf(out, "  Display:     0x%016llX / 0x%016llX\n", (unsigned long long)chip8_display_hash(a),
+              (unsigned long long)chip8_display_hash(b));
+}
+
+static void record(Lockstep *ls) {
+   const Chip8 *ref = ls->ref;
+   LockstepInstr *entry = &ls->history[ls->history_head++ % LOCKSTEP_HISTORY];
+   entry->count = ls->retired;
+   entry->PC = ref->PC;
+   entry->instr = ((u16)ref->RAM[ref->PC % RAM_SIZE] << 8) | ref->RAM[(ref->PC + 1) % RAM_SIZE];
+}
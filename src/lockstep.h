@@ -0,0 +1,48 @@
+#ifndef _LOCKSTEP
+#define _LOCKSTEP
+#include "chip8.h"
+
+#define LOCKSTEP_HISTORY 32
+
+/*
+ * Differential execution of a candidate core against the reference core (chip8_run).
+ * Both instances are fed the same ROM, seed and input, and their architectural state
+ * is compared every check_every retired instructions.
+ */
+
+typedef struct LockstepInstr {
+   u64 count; // retired instructions before this one
+   u16 PC;
+   u16 instr;
+} LockstepInstr;
+
+typedef struct Lockstep {
+   Chip8 *ref;
+   Chip8 *cand;
+   Chip8Core core;
+
+   u32 check_every;
+   u64 retired;
+   u64 next_check;
+   bool diverged;
+   bool faulted; // the ROM itself faulted, both sides stop there
+
+   // ring buffer of the most recent reference instructions
+   LockstepInstr history[LOCKSTEP_HISTORY];
+   u32 history_head;
+} Lockstep;
+
+void lockstep_init(Lockstep *ls, Chip8Core core, u32 check_every, void *app, u32 size, u32 seed);
+void lockstep_terminate(Lockstep *ls);
+
+// false once the candidate has diverged or either side has faulted
+bool lockstep_run_frame(Lockstep *ls, u16 keys_down, u8 key_released, u32 instructions);
+bool lockstep_check(Lockstep *ls);
+
+void lockstep_dump(const Lockstep *ls, FILE *out);
+
+// architectural state comparison, usable on any pair of instances
+bool lockstep_equal(const Chip8 *a, const Chip8 *b);
+void lockstep_dump_diff(const Chip8 *a, const Chip8 *b, FILE *out);
+
+#endif
@@ -0,0 +1,123 @@
+#include "chip8.h"
+#include "lockstep.h"
+#include "utils.h"
+
+/*
+ * Runs every candidate core in lockstep with the reference core over the given ROMs.
+ * Input is pseudo-random but identical for both sides.
+ *
+ * Usage: lockstep [--core name] [--every N] [--frames F] [--ipf K] rom...
+ */
+
+#define DEFAULT_EVERY 16
+#define DEFAULT_FRAMES 600
+#define DEFAULT_IPF 12
+#define LOCKSTEP_SEED 1
+
+typedef struct NamedCore {
+   const char *name;
+   Chip8Core core;
+} NamedCore;
+
+static const NamedCore CORES[] = {
+    {"ref", chip8_run},
+    {"fused", chip8_run_fused},
+};
+
+#define NUM_CORES (sizeof(CORES) / sizeof(CORES[0]))
+
+static bool run_rom(const char *path, const NamedCore *core, u32 every, u32 frames, u32 ipf);
+
+int main(int argc, char **argv) {
+   const char *only = NULL;
+   u32 every = DEFAULT_EVERY;
+   u32 frames = DEFAULT_FRAMES;
+   u32 ipf = DEFAULT_IPF;
+
+   s32 first_rom = argc;
+   for (s32 i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--core") == 0 && i + 1 < argc)
+         only = argv[++i];
+      else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc)
+         every = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+         frames = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc)
+         ipf = atoi(argv[++i]);
+      else {
+         first_rom = i;
+         break;
+      }
+   }
+
+   if (first_rom == argc) {
+      printf("Usage: lockstep [--core name] [--every N] [--frames F] [--ipf K] rom...\n");
+      return 1;
+   }
+
+   const u64 time_beg = time_in_ns();
+
+   u32 runs = 0;
+   u32 failures = 0;
+   for (u32 c = 0; c < NUM_CORES; ++c) {
+      if (only && strcmp(only, CORES[c].name) != 0)
+         continue;
+      for (s32 i = first_rom; i < argc; ++i) {
+         ++runs;
+         if (!run_rom(argv[i], &CORES[c], every, frames, ipf))
+            ++failures;
+      }
+   }
+
+   printf("%u / %u runs matched in %.3f ms\n", runs - failures, runs, (time_in_ns() - time_beg) / 1000000.0);
+   return failures == 0 ? 0 : 1;
+}
+
+static bool run_rom(const char *path, const NamedCore *core, u32 every, u32 frames, u32 ipf) {
+   u32 app_size = 0;
+   void *app = read_bin_file((char *)path, &app_size);
+   if (!app) {
+      printf("MISSING %s\n", path);
+      return false;
+   }
+
+   Lockstep ls;
+   lockstep_init(&ls, core->core, every, app, app_size, LOCKSTEP_SEED);
+   free(app);
+
+   // hold a random key for a few frames now and then, so input paths get exercised
+   u32 rng = LOCKSTEP_SEED;
+   u8 held = KEY_NONE;
+   u32 hold = 0;
+
+   bool ok = true;
+   for (u32 frame = 0; frame < frames && ok; ++frame) {
+      u8 released = KEY_NONE;
+      if (hold > 0 && --hold == 0) {
+         released = held;
+         held = KEY_NONE;
+      } else if (held == KEY_NONE) {
+         rng ^= rng << 13;
+         rng ^= rng >> 17;
+         rng ^= rng << 5;
+         if (rng % 8 == 0) {
+            held = (rng >> 8) % NUM_KEYS;
+            hold = 1 + (rng >> 16) % 8;
+         }
+      }
+
+      ok = lockstep_run_frame(&ls, held == KEY_NONE ? 0 : 1 << held, released, ipf);
+   }
+   ok = !ls.diverged && lockstep_check(&ls);
+
+   if (ok && ls.faulted)
+      printf("%-8s %-6s %s (faulted at 0x%04hX: %s)\n", "MATCH", core->name, path, ls.ref->PC,
+             chip8_fault_reason(ls.ref));
+   else
+      printf("%-8s %-6s %s\n", ok ? "MATCH" : "DIVERGE", core->name, path);
+   if (!ok)
+      lockstep_dump(&ls, stdout);
+
+   lockstep_terminate(&ls);
+   return ok;
+}
@@ -1,5 +1,11 @@
 #include "SDL_scancode.h"
+#include "capture.h"
 #include "chip8.h"
+#include "debug.h"
+#include "debug_server.h"
+#include "ipf.h"
+#include "netplay.h"
+#include "prof.h"
 #include "sdl_helper.h"
 #include "types.h"
 #include "utils.h"
@@ -10,8 +16,16 @@
 #define AUDIO_PATH "../assets/beep.wav"
 #endif
 
-#define INSTRUCTIONS_PER_SECOND 700
-#define BUDGET_IN_MICROSECONDS (1000000 / INSTRUCTIONS_PER_SECOND)
+// Shipped per-ROM instructions per frame profiles, read only (calibrated ones go to the user's cache, ipf.h)
+#ifndef IPF_PROFILE_PATH
+#define IPF_PROFILE_PATH "../roms/ipf.txt"
+#endif
+
+#define FRAMES_PER_SECOND 60 // emulated frames run the ROM's instructions per frame (ipf.h) then tick the timers
+#define FRAME_NS (1000000000ull / FRAMES_PER_SECOND)
+#define UNCAPPED_BUDGET_NS (FRAME_NS * 3 / 4) // uncapped speed leaves the rest of a host frame to presenting
+
+#define PROF_OVERLAY_NS 1000000000ull // F2 overlay refresh period
 
 #define PIXEL_OFF_COLOR 14
 #define PIXEL_ON_COLOR 255
@@ -57,21 +71,106 @@ int main(int argc, char **argv) {
        .title = "Chip 8 Emulator", .width = DISPLAY_WIDTH * PIXEL_DIM, .height = DISPLAY_HEIGHT * PIXEL_DIM};
    SDLCtx *sdl = sdl2_init(&sdl_conf);
 
+   // --debug starts paused in the debugger, F1 breaks into it at any time
+   // --server path lets external tools drive the debugger over a Unix socket instead
+   // --speed N runs N emulated frames per host frame (0 uncapped), holding TAB switches to --turbo N (uncapped default)
+   // --frameskip M presents every Mth host frame only
+   // --calibrate measures the ROM's instructions per frame again, ROMs without a profile are calibrated on first run
+   // --net P port host:port plays as player P (0 or 1) against a peer over UDP, with rollback (netplay.h)
+   // --prof path writes the host frame profile there on exit (prof.h), F2 toggles a live overlay of it
+   char *rom = NULL;
+   bool debug = false;
+   DebugServer *server = NULL;
+   Capture *capture = NULL;
+   const char *capture_path = NULL;
+   u32 capture_scale = CAPTURE_DEFAULT_SCALE;
+   u32 speed = 1;
+   u32 turbo = 0;
+   u32 frameskip = 1;
+   bool calibrate = false;
+   Netplay *net = NULL;
+   s32 net_player = -1;
+   u16 net_port = 0;
+   const char *net_peer = NULL;
+   const char *prof_path = NULL;
+   for (s32 i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--debug") == 0)
+         debug = true;
+      else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+         if (!(server = server_init(argv[++i])))
+            exit(0); // server_init says why
+      } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+         capture_path = argv[++i]; // .gif for an animated GIF, a delta-RLE stream otherwise
+      else if (strcmp(argv[i], "--capture-scale") == 0 && i + 1 < argc)
+         capture_scale = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+         speed = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--turbo") == 0 && i + 1 < argc)
+         turbo = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--frameskip") == 0 && i + 1 < argc)
+         frameskip = atoi(argv[++i]) > 0 ? atoi(argv[i]) : 1;
+      else if (strcmp(argv[i], "--calibrate") == 0)
+         calibrate = true;
+      else if (strcmp(argv[i], "--net") == 0 && i + 3 < argc) {
+         net_player = atoi(argv[++i]);
+         net_port = atoi(argv[++i]);
+         net_peer = argv[++i];
+      } else if (strcmp(argv[i], "--prof") == 0 && i + 1 < argc)
+         prof_path = argv[++i];
+      else
+         rom = argv[i];
+   }
+
    // load ROM
    void *app = NULL;
+   IpfAdapt ipf = {0};
    {
-      if (argc <= 1) {
+      if (!rom) {
          printf("Please supply the path to the ROM! (.ch8)\n");
          exit(0);
       }
 
       u32 app_size = 0;
-      app = read_bin_file(argv[1], &app_size);
+      app = read_bin_file(rom, &app_size);
       if (!app) {
          printf("ROM file was not found, check your path\n");
          exit(0);
       }
       chip8_load_app(ch8, app, app_size);
+
+      IpfProfile profile;
+      char cache[512];
+      const bool cached = ipf_cache_path(cache, sizeof(cache));
+      const u64 hash = ipf_rom_hash(app, app_size);
+      const char *slash = strrchr(rom, '/');
+      if (!calibrate && ((cached && ipf_load(cache, hash, &profile)) || ipf_load(IPF_PROFILE_PATH, hash, &profile))) {
+         ipf_adapt_init(&ipf, &profile);
+      } else if (ipf_calibrate(app, app_size, slash ? slash + 1 : rom, &profile)) {
+         if (cached)
+            ipf_save(cache, &profile);
+         ipf_adapt_init(&ipf, &profile);
+      }
+      if (ipf.base)
+         printf("%u instructions per frame (%s)\n", ipf.base, ipf.synced ? "timer paced" : "fixed");
+
+      if (debug)
+         dbg_attach(ch8);
+      if (capture_path)
+         capture = capture_init(capture_path, capture_scale);
+
+      // both peers need the same instructions per frame, so no runtime adaptation
+      if (net_peer) {
+         char host[256];
+         const char *colon = strrchr(net_peer, ':');
+         snprintf(host, sizeof(host), "%.*s", colon ? (int)(colon - net_peer) : 0, net_peer);
+         const int fd = colon && !server ? net_open_udp(net_port, host, atoi(colon + 1)) : -1;
+         if (fd >= 0)
+            net = net_init(fd, net_player, ch8, ipf.base ? ipf.base : IPF_DEFAULT_IPF);
+         if (!net) {
+            printf("Netplay needs --net 0|1 port host:port, and no debugger\n");
+            exit(0);
+         }
+      }
    }
 
    // load beep sound
@@ -103,10 +202,34 @@ int main(int argc, char **argv) {
 
    bool beep = false;
 
+   u64 host_frame = 0;
+   bool dirty = false; // drawn but not presented yet
+   u64 deadline = time_in_ns();
+
+   // host frame phases, sleep overshoot past the deadline and how late frames that missed it were
+   Profiler *prof = prof_init();
+   if (!prof)
+      exit(0);
+   const u32 p_frame = prof_scope(prof, "frame", PROF_ROOT);
+   const u32 p_events = prof_scope(prof, "events", p_frame);
+   const u32 p_debug = prof_scope(prof, "debug", p_frame);
+   const u32 p_emulate = prof_scope(prof, "emulate", p_frame);
+   const u32 p_present = prof_scope(prof, "present", p_frame);
+   const u32 p_update = prof_scope(prof, "update", p_present);
+   const u32 p_capture = prof_scope(prof, "capture", p_frame);
+#ifdef INTERNAL_VISUALIZER
+   const u32 p_viz = prof_scope(prof, "viz", p_frame);
+#endif
+   const u32 p_sleep = prof_scope(prof, "sleep", p_frame);
+   const u32 p_overshoot = prof_scope(prof, "overshoot", p_sleep);
+   const u32 p_late = prof_scope(prof, "late", PROF_ROOT);
+   bool overlay = false;
+
    bool keep_window_open = true;
    while (keep_window_open) {
-      u64 time_beg = time_in_ms();
-
+      bool drew = false; // this host frame, captured even when it is not presented
+      prof_begin(prof, p_frame);
+      prof_begin(prof, p_events);
       sdl2_pump_events(sdl);
 
       // use ESC for QUIT as well
@@ -121,23 +244,71 @@ int main(int argc, char **argv) {
             break;
          }
       }
+      prof_end(prof, p_events);
+
+      if (sdl2_is_key_released(sdl, SDL_SCANCODE_F2)) {
+         overlay = !overlay;
+         prof_window_reset(prof);
+         if (!overlay)
+            SDL_SetWindowTitle(sdl->window, sdl_conf.title);
+      }
 
-      // fetch, decode, execute
-      chip8_tick(ch8, get_ch8_keydown(sdl), get_ch8_keyup(sdl));
+      prof_begin(prof, p_debug);
+      if (sdl2_is_key_released(sdl, SDL_SCANCODE_F1) && !net)
+         dbg_pause(dbg_attach(ch8), DBG_USER, ch8->PC);
+      if (server)
+         drew |= server_poll(server, ch8);
+      else if (ch8->DBG && dbg_paused(ch8->DBG) && !dbg_repl(ch8, stdin, stdout))
+         keep_window_open = false;
+      prof_end(prof, p_debug);
+
+      // emulated frames for this host frame, timers tick per emulated frame so they scale with the speed
+      // netplay runs one frame per host frame, rolling back to correct mispredicted frames of the other player
+      const u32 multiplier = net ? 1 : sdl2_is_key_down(sdl, SDL_SCANCODE_TAB) ? turbo : speed;
+      prof_begin(prof, p_emulate);
+      const u64 emu_beg = time_in_ns();
+      if (net)
+         drew |= net_advance(net, chip8_host_keypad(get_ch8_keydown(sdl)));
+      else
+         chip8_set_host_keys(ch8, get_ch8_keydown(sdl), get_ch8_keyup(sdl));
+      for (u32 f = 0; !net && (multiplier ? f < multiplier : time_in_ns() - emu_beg < UNCAPPED_BUDGET_NS); ++f) {
+         chip8_run_fused(ch8, ipf_next(&ipf));
+         drew |= chip8_should_draw(ch8);
+         if (chip8_faulted(ch8) || (ch8->DBG && dbg_paused(ch8->DBG)))
+            break;
+         ipf_frame_done(&ipf, ch8->WAITED);
+         chip8_tick_timers(ch8);
+         ch8->KEY_RELEASED = KEY_NONE; // a release lasts one emulated frame
+      }
+      prof_end(prof, p_emulate);
+      if (chip8_faulted(ch8)) {
+         printf("Faulted at 0x%04hX: %s\n", ch8->PC, chip8_fault_reason(ch8));
+         break; // still close the capture and server
+      }
 
-      // toggle noise
-      if (!beep && chip8_should_beep(ch8)) {
+      // toggle noise, muted while running at any other speed
+      const bool should_beep = chip8_should_beep(ch8) && multiplier == 1;
+      if (!beep && should_beep) {
          SDL_PauseAudio(0); // resume
-         beep = chip8_should_beep(ch8);
-      } else if (beep && !chip8_should_beep(ch8)) {
+         beep = should_beep;
+      } else if (beep && !should_beep) {
          SDL_PauseAudio(1); // pause
-         beep = chip8_should_beep(ch8);
+         beep = should_beep;
       }
       if (dat.len == 0)
          dat = dat_base; // keep resetting wav
 
+      prof_begin(prof, p_capture);
+      if (capture && drew)
+         capture_frame(capture, ch8, time_in_ms());
+      prof_end(prof, p_capture);
+
       // color the screen
-      if (chip8_should_draw(ch8)) {
+      dirty |= drew;
+      const bool present = host_frame++ % frameskip == 0;
+      if (dirty && present) {
+         prof_begin(prof, p_present);
+         dirty = false;
          for (int y = 0; y < DISPLAY_HEIGHT; ++y) {
             for (int x = 0; x < DISPLAY_WIDTH; ++x) {
                const u8 color = ch8->DISPLAY[y][x] ? PIXEL_ON_COLOR : PIXEL_OFF_COLOR;
@@ -148,26 +319,64 @@ int main(int argc, char **argv) {
                SDL_FillRect(sdl->surface, &rect, SDL_MapRGB(sdl->surface->format, color, color, color));
             }
          }
+         prof_begin(prof, p_update);
          SDL_UpdateWindowSurface(sdl->window);
+         prof_end(prof, p_update);
+         if (server)
+            server_frame(server, ch8);
+         prof_end(prof, p_present);
       }
 
 #ifdef INTERNAL_VISUALIZER
+      prof_begin(prof, p_viz);
       chip8_viz(ch8);
+      prof_end(prof, p_viz);
 #endif
 
-      u64 time_diff_us = (time_in_ms() - time_beg) * 1000;
-      if (time_diff_us > BUDGET_IN_MICROSECONDS)
-         continue;
-
-      u64 sleep = BUDGET_IN_MICROSECONDS - time_diff_us;
-      if (chip8_sync_display())
-         usleep(sleep); // usleep takes microsecs
+      // absolute deadlines so sleep overshoot does not accumulate, after a long stall (debugger, slow host) start over
+      deadline += FRAME_NS;
+      const u64 now = time_in_ns();
+      if (now < deadline) {
+         prof_begin(prof, p_sleep);
+         usleep((deadline - now) / 1000); // usleep takes microsecs
+         prof_end(prof, p_sleep);
+         const u64 woke = time_in_ns();
+         prof_value(prof, p_overshoot, woke > deadline ? woke - deadline : 0);
+      } else {
+         prof_value(prof, p_late, now - deadline);
+         if (now - deadline > FRAME_NS)
+            deadline = now;
+      }
+      prof_end(prof, p_frame);
+      prof_frame_end(prof);
+
+      if (overlay && time_in_ns() - prof->window_beg_ns >= PROF_OVERLAY_NS) {
+         const ProfHistogram *emulate = &prof->scopes[p_emulate].window;
+         const ProfHistogram *late = &prof->scopes[p_late].window;
+         char title[128];
+         snprintf(title, sizeof(title), "%s | emulate %.2f ms, frame p99 %.2f ms, %llu missed", sdl_conf.title,
+                  emulate->count ? emulate->total_ns / 1e6 / emulate->count : 0,
+                  prof_percentile(&prof->scopes[p_frame].window, 0.99) / 1e6, (unsigned long long)late->count);
+         SDL_SetWindowTitle(sdl->window, title);
+         printf("\n");
+         prof_print(prof, true, stdout);
+         prof_window_reset(prof);
+      }
    }
 
+   if (prof_path)
+      prof_export(prof, prof_path);
+   prof_terminate(&prof);
+
    SDL_CloseAudio();
    SDL_FreeWAV(dat_base.buf);
 
    free(app);
+   if (net)
+      close(net->fd);
+   net_terminate(&net);
+   server_terminate(&server);
+   capture_terminate(&capture);
    sdl2_terminate(&sdl);
    chip8_terminate(&ch8);
    return 0;
@@ -0,0 +1,201 @@
+#include "netplay.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SLOT(frame) ((frame) % NET_HISTORY)
+
+static bool catch_up(Netplay *np);
+static void receive(Netplay *np);
+static void resimulate(Netplay *np);
+static void confirm(Netplay *np);
+static void run_frame(Netplay *np);
+static void send_inputs(Netplay *np);
+
+Netplay *net_init(int fd, u8 player, Chip8 *state, u32 ipf) {
+   if (player > 1 || state->DBG || ipf == 0)
+      return NULL;
+
+   Netplay *np = calloc(1, sizeof(*np));
+   if (!np) {
+      printf("Failed to allocate netplay history\n");
+      return NULL;
+   }
+   np->fd = fd;
+   np->player = player;
+   np->ipf = ipf;
+   np->state = state;
+   np->hash_frames[0] = UINT32_MAX;
+   confirm(np);
+   return np;
+}
+
+void net_terminate(Netplay **np) {
+   free(*np);
+   *np = NULL;
+}
+
+int net_open_udp(u16 local_port, const char *host, u16 port) {
+   char service[8];
+   snprintf(service, sizeof(service), "%u", port);
+   struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+   struct addrinfo *peer = NULL;
+   if (getaddrinfo(host, service, &hints, &peer) != 0) {
+      printf("Failed to resolve %s\n", host);
+      return -1;
+   }
+
+   const struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(local_port)};
+   const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+   if (fd < 0 || bind(fd, (const struct sockaddr *)&local, sizeof(local)) != 0 ||
+       connect(fd, peer->ai_addr, peer->ai_addrlen) != 0 || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+      printf("Failed to open UDP port %u to %s:%u\n", local_port, host, port);
+      if (fd >= 0)
+         close(fd);
+      freeaddrinfo(peer);
+      return -1;
+   }
+   freeaddrinfo(peer);
+   return fd;
+}
+
+bool net_advance(Netplay *np, u16 local_keys) {
+   const bool corrected = catch_up(np);
+   if (np->frame - np->confirmed >= NET_MAX_ROLLBACK) {
+      ++np->stalls;
+      send_inputs(np);
+      return corrected;
+   }
+
+   np->local[SLOT(np->frame)] = local_keys;
+   run_frame(np);
+   confirm(np);
+   send_inputs(np);
+   return corrected || np->state->SHOULD_DRAW;
+}
+
+bool net_poll(Netplay *np) {
+   const bool corrected = catch_up(np);
+   send_inputs(np);
+   return corrected;
+}
+
+u64 net_state_hash(const Chip8 *state) {
+   u64 hash = HASH_OFFSET;
+   hash = hash_bytes(hash, state->RAM, RAM_SIZE);
+   hash = hash_bytes(hash, state->DISPLAY, sizeof(state->DISPLAY));
+   hash = hash_bytes(hash, state->STACK.addresses, state->STACK.head * sizeof(state->STACK.addresses[0]));
+   hash = hash_bytes(hash, state->GPR, NUM_GPRS);
+   const u16 regs[] = {state->PC, state->I, state->STACK.head, state->DELAY_TIMER, state->SOUND_TIMER,
+                       state->KEYS_DOWN, state->RNG & 0xFFFF, state->RNG >> 16, state->FAULT};
+   return hash_bytes(hash, regs, sizeof(regs));
+}
+
+static bool catch_up(Netplay *np) {
+   receive(np);
+   const bool corrected = np->rollback_to < np->frame;
+   if (corrected)
+      resimulate(np);
+   confirm(np);
+   return corrected;
+}
+
+static void receive(Netplay *np) {
+   NetPacket packet;
+   for (;;) {
+      const ssize_t n = recv(np->fd, &packet, sizeof(packet), MSG_DONTWAIT);
+      if (n < 0)
+         break;
+      if (n != sizeof(packet) || packet.magic != NET_MAGIC || packet.player != 1 - np->player ||
+          packet.count > NET_WINDOW)
+         continue; // not from the peer, or another build
+      ++np->packets_in;
+
+      for (u32 k = 0; k < packet.count; ++k) {
+         const u32 frame = packet.first + k;
+         // older ones are confirmed already, newer ones would overwrite slots still in use
+         if (frame < np->confirmed || frame >= np->confirmed + NET_HISTORY || np->known[SLOT(frame)])
+            continue;
+
+         if (frame < np->frame && np->remote[SLOT(frame)] != packet.keys[k] && frame < np->rollback_to)
+            np->rollback_to = frame;
+         np->remote[SLOT(frame)] = packet.keys[k];
+         np->known[SLOT(frame)] = true;
+      }
+      if (packet.sync_frame > np->remote_sync_frame) {
+         np->remote_sync_frame = packet.sync_frame;
+         np->remote_sync_hash = packet.sync_hash;
+      }
+   }
+}
+
+static void resimulate(Netplay *np) {
+   const u32 frame = np->frame;
+   const u32 depth = frame - np->rollback_to;
+   ++np->rollbacks;
+   np->resimulated += depth;
+   np->max_rollback = depth > np->max_rollback ? depth : np->max_rollback;
+
+   *np->state = np->saves[SLOT(np->rollback_to)];
+   for (np->frame = np->rollback_to; np->frame < frame;)
+      run_frame(np);
+}
+
+static void confirm(Netplay *np) {
+   const u32 confirmed = np->confirmed;
+   while (np->confirmed < np->frame && np->known[SLOT(np->confirmed)])
+      np->known[SLOT(np->confirmed++)] = false; // the slot is free for a frame NET_HISTORY later
+
+   // every frame before confirmed ran on real input, so the state before it is the same on both peers
+   const u32 slot = SLOT(np->confirmed);
+   if (np->confirmed != confirmed || np->hash_frames[slot] != np->confirmed) {
+      const Chip8 *state = np->confirmed == np->frame ? np->state : &np->saves[slot];
+      np->hashes[slot] = net_state_hash(state);
+      np->hash_frames[slot] = np->confirmed;
+   }
+
+   const u32 sync = np->remote_sync_frame;
+   if (sync > np->checked && np->hash_frames[SLOT(sync)] == sync) {
+      np->desyncs += np->hashes[SLOT(sync)] != np->remote_sync_hash;
+      np->checked = sync;
+   }
+}
+
+static void run_frame(Netplay *np) {
+   const u32 slot = SLOT(np->frame);
+   if (!np->known[slot])
+      np->remote[slot] = np->frame ? np->remote[SLOT(np->frame - 1)] : 0; // keys held on
+
+   // releases come from the keys of the frame before, which every save carries along
+   Chip8 *state = np->state;
+   np->saves[slot] = *state;
+   const u16 keys = np->local[slot] | np->remote[slot];
+   const u16 released = state->KEYS_DOWN & ~keys;
+   chip8_set_keypad(state, keys, released ? __builtin_ctz(released) : KEY_NONE);
+   chip8_run_fused(state, np->ipf);
+   if (!state->FAULT)
+      chip8_tick_timers(state);
+
+   np->rollback_to = ++np->frame;
+}
+
+static void send_inputs(Netplay *np) {
+   // sent as raw bytes, the padding must not carry stack contents
+   NetPacket packet;
+   memset(&packet, 0, sizeof(packet));
+   packet.magic = NET_MAGIC;
+   packet.player = np->player;
+   packet.first = np->frame > NET_WINDOW ? np->frame - NET_WINDOW : 0;
+   packet.count = np->frame - packet.first;
+   for (u32 k = 0; k < packet.count; ++k)
+      packet.keys[k] = np->local[SLOT(packet.first + k)];
+   packet.sync_frame = np->confirmed;
+   packet.sync_hash = np->hashes[SLOT(np->confirmed)];
+
+   // a full socket buffer drops it like the network would, the next one carries the same inputs
+   if (send(np->fd, &packet, sizeof(packet), MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(packet))
+      ++np->packets_out;
+}
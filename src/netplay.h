@@ -0,0 +1,82 @@
+#ifndef _NETPLAY
+#define _NETPLAY
+#include "chip8.h"
+
+#define NET_MAX_ROLLBACK 8                     // frames a peer runs ahead on predicted input before it stalls
+#define NET_WINDOW (2 * NET_MAX_ROLLBACK)      // local inputs resent in every packet, as far as a peer can lag behind
+#define NET_HISTORY (4 * NET_MAX_ROLLBACK)     // ring of frames kept, power of two
+#define NET_MAGIC 0x4E385043                   // "C8PN"
+
+/*
+ * Rollback netplay between two peers running the same ROM.
+ *
+ * Each peer owns one player's keypad bitmask and the instance sees both ORed together. A frame never waits for the
+ * other player: it runs on a prediction (the remote keys last seen) and the state before it is saved. When the real
+ * input arrives and differs, the instance is restored to the save of the first mispredicted frame and the frames since
+ * are run again, within the same host frame, so the caller presents the corrected display right away. A peer that
+ * gets NET_MAX_ROLLBACK frames ahead of the input it has stalls until the other catches up.
+ *
+ * Every packet resends the last NET_WINDOW local inputs, so lost or reordered datagrams need no acknowledgement, and
+ * carries the state hash before the newest frame whose inputs are all known, which the other side checks for desyncs.
+ * Packets are raw structs, both peers have to run the same build. Any connected datagram socket works: one end of a
+ * socketpair, or UDP (net_open_udp).
+ */
+
+typedef struct NetPacket {
+   u32 magic;
+   u32 first;      // frame of keys[0]
+   u32 sync_frame; // the sender's confirmed frame
+   u64 sync_hash;  // net_state_hash before sync_frame
+   u16 count;
+   u8 player;
+   u16 keys[NET_WINDOW];
+} NetPacket;
+
+typedef struct Netplay {
+   int fd;
+   u8 player; // local one, 0 or 1
+   u32 ipf;
+   Chip8 *state; // live instance, owned by the caller
+
+   u32 frame;     // next frame to run
+   u32 confirmed; // remote input known for every frame before it, at most frame
+   u32 rollback_to; // first mispredicted frame, frame when none
+
+   // ring slots by frame % NET_HISTORY
+   u16 local[NET_HISTORY];
+   u16 remote[NET_HISTORY]; // as run: real input when known, prediction otherwise
+   bool known[NET_HISTORY]; // real remote input arrived, for frames from confirmed on
+   Chip8 saves[NET_HISTORY]; // state before each frame run
+   u64 hashes[NET_HISTORY];  // state hash before each confirmed frame
+   u32 hash_frames[NET_HISTORY];
+
+   u32 remote_sync_frame;
+   u64 remote_sync_hash;
+   u32 checked; // newest frame compared with the peer
+
+   // stats
+   u64 rollbacks;
+   u64 resimulated; // frames run again
+   u32 max_rollback;
+   u64 stalls;  // host frames spent waiting on the peer
+   u64 desyncs; // confirmed frames whose hash differed from the peer's
+   u64 packets_in;
+   u64 packets_out;
+} Netplay;
+
+// state is loaded and seeded alike on both peers, with no debugger attached
+Netplay *net_init(int fd, u8 player, Chip8 *state, u32 ipf);
+void net_terminate(Netplay **np); // fd and state stay with the caller
+
+// nonblocking UDP socket bound to local_port and connected to host:port, -1 on failure
+int net_open_udp(u16 local_port, const char *host, u16 port);
+
+// one host frame: takes in remote inputs, rolls back if they were mispredicted, then runs the next frame with
+// local_keys (keypad bitmask) unless too far ahead of the peer. Returns true when the display should be presented.
+bool net_advance(Netplay *np, u16 local_keys);
+// same without running a frame, keeps inputs flowing while the caller is not advancing
+bool net_poll(Netplay *np);
+
+u64 net_state_hash(const Chip8 *state); // everything that decides how the instance runs on
+
+#endif
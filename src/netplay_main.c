@@ -0,0 +1,266 @@
+#include "netplay.h"
+#include "utils.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Plays a ROM with two rollback netplay peers (netplay.h) in two processes and checks that both end up where a single
+ * instance fed the same inputs does. Each player holds scripted keys, player 1 the left side of the keypad and player
+ * 2 the right, so two-player ROMs like Pong see both paddles move.
+ *
+ * Usage: netplay [--frames N] [--latency F] [--loss P] [--frame-us U] [--ipf K] [--udp PORT] rom
+ *   --latency  : one-way delay in host frames, added by a relay between the players
+ *   --loss     : percentage of packets the relay drops
+ *   --frame-us : host frame length in microseconds, shorter than a real 60 Hz frame to finish sooner
+ *   --udp      : connect the players over UDP loopback on PORT and PORT + 1 instead, with no relay
+ */
+
+#define DEFAULT_FRAMES 1200
+#define DEFAULT_LATENCY 3
+#define DEFAULT_LOSS 5
+#define DEFAULT_FRAME_US 2000
+#define DEFAULT_IPF 12
+
+#define SCRIPT_HOLD 8        // frames a scripted key choice lasts
+#define LINGER_FRAMES 60     // host frames still sent after finishing, for the peer to finish too
+#define TIMEOUT_FRAMES 30000 // host frames before a player gives up
+#define RELAY_QUEUE 4096     // packets in flight per direction
+
+typedef struct PlayerResult {
+   u8 player;
+   bool done;
+   u64 hash;
+   u64 host_frames;
+   u64 rollbacks;
+   u64 resimulated;
+   u32 max_rollback;
+   u64 stalls;
+   u64 desyncs;
+   u64 packets_in;
+   u64 packets_out;
+} PlayerResult;
+
+typedef struct Relayed {
+   u64 due_ns;
+   u32 size;
+   u8 data[sizeof(NetPacket)];
+} Relayed;
+
+static u16 script_keys(u8 player, u32 frame);
+static PlayerResult play(int fd, u8 player, void *app, u32 app_size, u32 frames, u32 ipf, u64 frame_ns);
+static void relay(int fds[2], const pid_t pids[2], u64 latency_ns, u32 loss);
+static u64 reference_hash(void *app, u32 app_size, u32 frames, u32 ipf);
+
+int main(int argc, char **argv) {
+   u32 frames = DEFAULT_FRAMES;
+   u32 latency = DEFAULT_LATENCY;
+   u32 loss = DEFAULT_LOSS;
+   u32 frame_us = DEFAULT_FRAME_US;
+   u32 ipf = DEFAULT_IPF;
+   u32 udp_port = 0;
+   char *rom = NULL;
+
+   for (s32 i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+         frames = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc)
+         latency = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc)
+         loss = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--frame-us") == 0 && i + 1 < argc)
+         frame_us = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc)
+         ipf = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--udp") == 0 && i + 1 < argc)
+         udp_port = atoi(argv[++i]);
+      else
+         rom = argv[i];
+   }
+
+   if (!rom || frames == 0 || ipf == 0 || loss >= 100 || udp_port > UINT16_MAX - 1) {
+      printf("Usage: netplay [--frames N] [--latency F] [--loss P] [--frame-us U] [--ipf K] [--udp PORT] rom\n");
+      return 1;
+   }
+
+   u32 app_size = 0;
+   void *app = read_bin_file(rom, &app_size);
+   if (!app) {
+      printf("MISSING %s\n", rom);
+      return 1;
+   }
+
+   // relay ends [0], player ends [1]
+   int pairs[2][2];
+   for (u32 p = 0; p < 2 && !udp_port; ++p) {
+      if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pairs[p]) != 0) {
+         printf("Failed to create a socket pair\n");
+         return 1;
+      }
+   }
+
+   int results[2];
+   pid_t pids[2];
+   if (pipe(results) != 0) {
+      printf("Failed to create a pipe\n");
+      return 1;
+   }
+   fflush(stdout);
+   for (u8 p = 0; p < 2; ++p) {
+      pids[p] = fork();
+      if (pids[p] == 0) {
+         const int fd = udp_port ? net_open_udp(udp_port + p, "127.0.0.1", udp_port + 1 - p) : pairs[p][1];
+         PlayerResult result = {.player = p};
+         if (fd >= 0)
+            result = play(fd, p, app, app_size, frames, ipf, frame_us * 1000ull);
+         write(results[1], &result, sizeof(result)); // atomic, well below PIPE_BUF
+         _exit(0);
+      }
+   }
+
+   if (udp_port) {
+      for (u32 p = 0; p < 2; ++p)
+         waitpid(pids[p], NULL, 0);
+   } else {
+      const int fds[2] = {pairs[0][0], pairs[1][0]};
+      relay((int *)fds, pids, latency * frame_us * 1000ull, loss);
+   }
+
+   // in the order the players finished
+   PlayerResult players[2] = {0};
+   PlayerResult result;
+   close(results[1]);
+   while (read(results[0], &result, sizeof(result)) == sizeof(result))
+      players[result.player & 1] = result;
+
+   const u64 expected = reference_hash(app, app_size, frames, ipf);
+   free(app);
+
+   bool ok = true;
+   for (u32 p = 0; p < 2; ++p) {
+      const PlayerResult *r = &players[p];
+      printf("peer %u: %llu rollbacks (%llu frames run again, deepest %u), %llu stalled host frames, %llu desyncs, "
+             "%llu / %llu packets out / in\n",
+             p, (unsigned long long)r->rollbacks, (unsigned long long)r->resimulated, r->max_rollback,
+             (unsigned long long)r->stalls, (unsigned long long)r->desyncs, (unsigned long long)r->packets_out,
+             (unsigned long long)r->packets_in);
+      if (!r->done)
+         printf("peer %u: TIMEOUT\n", p);
+      else if (r->hash != expected)
+         printf("peer %u: MISMATCH %016llx, expected %016llx\n", p, (unsigned long long)r->hash,
+                (unsigned long long)expected);
+      ok &= r->done && r->hash == expected && r->desyncs == 0;
+   }
+   printf("%u frames, %u frames latency, %u%% loss: %s\n", frames, udp_port ? 0 : latency, udp_port ? 0 : loss,
+          ok ? "PASS" : "FAIL");
+   return ok ? 0 : 1;
+}
+
+static u16 script_keys(u8 player, u32 frame) {
+   static const u8 KEYS[2][2] = {{0x1, 0x4}, {0xC, 0xD}}; // Pong: up / down of each paddle
+   u32 x = (frame / SCRIPT_HOLD + 1) * 0x9E3779B9u ^ (player + 1) * 0x85EBCA6Bu;
+   x ^= x >> 15;
+   x *= 0x2C1B3C6Du;
+   x ^= x >> 12;
+   return x % 3 == 2 ? 0 : 1 << KEYS[player][x % 3];
+}
+
+static PlayerResult play(int fd, u8 player, void *app, u32 app_size, u32 frames, u32 ipf, u64 frame_ns) {
+   PlayerResult result = {.player = player};
+   Chip8 *state = chip8_init();
+   chip8_load_app(state, app, app_size);
+   Netplay *np = net_init(fd, player, state, ipf);
+
+   // play until every input is confirmed on both sides, then keep sending for a while for the peer's sake
+   u64 deadline = time_in_ns();
+   u32 linger = 0;
+   while (np && linger < LINGER_FRAMES && result.host_frames < TIMEOUT_FRAMES) {
+      if (np->frame < frames)
+         net_advance(np, script_keys(player, np->frame));
+      else
+         net_poll(np);
+      if (np->confirmed == frames && np->remote_sync_frame == frames)
+         ++linger;
+      ++result.host_frames;
+
+      deadline += frame_ns;
+      const u64 now = time_in_ns();
+      if (now < deadline)
+         usleep((deadline - now) / 1000);
+   }
+
+   if (np) {
+      result.done = linger == LINGER_FRAMES;
+      result.hash = net_state_hash(state);
+      result.rollbacks = np->rollbacks;
+      result.resimulated = np->resimulated;
+      result.max_rollback = np->max_rollback;
+      result.stalls = np->stalls;
+      result.desyncs = np->desyncs;
+      result.packets_in = np->packets_in;
+      result.packets_out = np->packets_out;
+   }
+   net_terminate(&np);
+   chip8_terminate(&state);
+   return result;
+}
+
+static void relay(int fds[2], const pid_t pids[2], u64 latency_ns, u32 loss) {
+   // fixed latency keeps each direction in order, a FIFO per direction is enough
+   Relayed *queues[2] = {calloc(RELAY_QUEUE, sizeof(Relayed)), calloc(RELAY_QUEUE, sizeof(Relayed))};
+   u32 heads[2] = {0}, tails[2] = {0};
+   u32 rng = 1;
+   bool running[2] = {true, true};
+
+   while (running[0] || running[1]) {
+      struct pollfd pfds[2] = {{.fd = fds[0], .events = POLLIN}, {.fd = fds[1], .events = POLLIN}};
+      poll(pfds, 2, 1);
+      const u64 now = time_in_ns();
+
+      for (u32 from = 0; from < 2; ++from) {
+         Relayed packet;
+         ssize_t n;
+         while ((n = recv(fds[from], packet.data, sizeof(packet.data), MSG_DONTWAIT)) > 0) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            if (rng % 100 < loss || tails[from] - heads[from] == RELAY_QUEUE)
+               continue; // lost
+            packet.size = n;
+            packet.due_ns = now + latency_ns;
+            queues[from][tails[from]++ % RELAY_QUEUE] = packet;
+         }
+      }
+
+      for (u32 from = 0; from < 2; ++from) {
+         while (heads[from] != tails[from] && queues[from][heads[from] % RELAY_QUEUE].due_ns <= now) {
+            const Relayed *packet = &queues[from][heads[from]++ % RELAY_QUEUE];
+            send(fds[1 - from], packet->data, packet->size, MSG_DONTWAIT | MSG_NOSIGNAL);
+         }
+      }
+
+      for (u32 p = 0; p < 2; ++p) {
+         if (running[p] && waitpid(pids[p], NULL, WNOHANG) == pids[p])
+            running[p] = false;
+      }
+   }
+   free(queues[0]);
+   free(queues[1]);
+}
+
+static u64 reference_hash(void *app, u32 app_size, u32 frames, u32 ipf) {
+   Chip8 *state = chip8_init();
+   chip8_load_app(state, app, app_size);
+   for (u32 f = 0; f < frames && !state->FAULT; ++f) {
+      const u16 keys = script_keys(0, f) | script_keys(1, f);
+      const u16 released = state->KEYS_DOWN & ~keys;
+      chip8_set_keypad(state, keys, released ? __builtin_ctz(released) : KEY_NONE);
+      chip8_run_fused(state, ipf);
+      if (!state->FAULT)
+         chip8_tick_timers(state);
+   }
+   const u64 hash = net_state_hash(state);
+   chip8_terminate(&state);
+   return hash;
+}
@@ -0,0 +1,240 @@
+#include "pool.h"
+
+#define MIN_PAGE_CAPACITY 64
+
+static void unpack_registers(const CompactChip8 *inst, Chip8 *state);
+static void release_pages(Chip8Pool *pool, CompactChip8 *inst);
+static u32 alloc_page(Chip8Pool *pool);
+static const u8 *page_data(const Chip8Pool *pool, const CompactChip8 *inst, u32 page);
+
+Chip8Pool *pool_init(u32 capacity, void *app, u32 size) {
+   if (capacity == 0 || size > RAM_SIZE - PROGRAM_START_ADR)
+      return NULL;
+
+   Chip8Pool *pool = calloc(1, sizeof(*pool));
+   pool->capacity = capacity;
+   pool->instances = calloc(capacity, sizeof(*pool->instances));
+   pool->free_ids = malloc(capacity * sizeof(*pool->free_ids));
+   if (!pool->instances || !pool->free_ids) {
+      printf("Failed to allocate %u instances\n", capacity);
+      pool_terminate(&pool);
+      return NULL;
+   }
+
+   // handed out lowest id first
+   for (u32 i = 0; i < capacity; ++i)
+      pool->free_ids[i] = capacity - 1 - i;
+   pool->num_free_ids = capacity;
+
+   chip8_reset(&pool->scratch);
+   chip8_load_app(&pool->scratch, app, size);
+   memcpy(pool->image, pool->scratch.RAM, RAM_SIZE);
+   for (u32 p = 0; p < RAM_PAGES; ++p)
+      pool->scratch_pages[p] = POOL_SHARED_PAGE;
+   return pool;
+}
+
+void pool_terminate(Chip8Pool **pool) {
+   if (*pool) {
+      free((*pool)->instances);
+      free((*pool)->free_ids);
+      free((*pool)->pages);
+      free((*pool)->free_pages);
+      free(*pool);
+   }
+   *pool = NULL;
+}
+
+u32 pool_alloc(Chip8Pool *pool, u32 seed) {
+   if (pool->num_free_ids == 0)
+      return POOL_NONE;
+
+   const u32 id = pool->free_ids[--pool->num_free_ids];
+   pool->instances[id].used = true;
+   pool->count++;
+   pool_reset(pool, id, seed);
+   return id;
+}
+
+void pool_free(Chip8Pool *pool, u32 id) {
+   CompactChip8 *inst = &pool->instances[id];
+   if (!inst->used)
+      return;
+
+   release_pages(pool, inst);
+   inst->used = false;
+   pool->free_ids[pool->num_free_ids++] = id;
+   pool->count--;
+}
+
+void pool_reset(Chip8Pool *pool, u32 id, u32 seed) {
+   release_pages(pool, &pool->instances[id]);
+
+   // packed from a power-on instance, every page still shared
+   Chip8 *state = &pool->scratch;
+   chip8_reset(state);
+   memcpy(state->RAM, pool->image, RAM_SIZE);
+   state->PC = PROGRAM_START_ADR;
+   chip8_seed(state, seed);
+   pool_store(pool, id, state);
+   for (u32 p = 0; p < RAM_PAGES; ++p)
+      pool->scratch_pages[p] = POOL_SHARED_PAGE;
+}
+
+void pool_load(const Chip8Pool *pool, u32 id, Chip8 *state) {
+   const CompactChip8 *inst = &pool->instances[id];
+   for (u32 p = 0; p < RAM_PAGES; ++p)
+      memcpy(&state->RAM[p * RAM_PAGE], page_data(pool, inst, p), RAM_PAGE);
+   unpack_registers(inst, state);
+}
+
+bool pool_store(Chip8Pool *pool, u32 id, const Chip8 *state) {
+   CompactChip8 *inst = &pool->instances[id];
+   bool stored = true;
+
+   // copy-on-write: a written page gets its own copy, or goes back to the shared one if it matches it again
+   for (u32 p = 0; p < RAM_PAGES; ++p) {
+      if (!(state->DIRTY & (1 << p)))
+         continue;
+
+      const u8 *data = &state->RAM[p * RAM_PAGE];
+      if (memcmp(data, &pool->image[p * RAM_PAGE], RAM_PAGE) == 0) {
+         if (inst->pages[p] != POOL_SHARED_PAGE) {
+            pool->free_pages[pool->num_free_pages++] = inst->pages[p] - 1;
+            inst->pages[p] = POOL_SHARED_PAGE;
+         }
+         continue;
+      }
+      if (inst->pages[p] == POOL_SHARED_PAGE) {
+         const u32 page = alloc_page(pool);
+         if (page == POOL_NONE) {
+            stored = false; // out of memory, the page keeps its old contents
+            continue;
+         }
+         inst->pages[p] = 1 + page;
+      }
+      memcpy(pool->pages[inst->pages[p] - 1], data, RAM_PAGE);
+
+      // the scratch copy of this page, if any, is stale now (pool_run puts it back)
+      for (u32 q = 0; q < RAM_PAGES; ++q) {
+         if (pool->scratch_pages[q] == inst->pages[p])
+            pool->scratch_pages[q] = POOL_NONE;
+      }
+   }
+   chip8_pack_display(state, inst->DISPLAY);
+
+   const bool fits = state->STACK.head <= POOL_STACK;
+   inst->SP = fits ? state->STACK.head : POOL_STACK;
+   memcpy(inst->STACK, state->STACK.addresses, inst->SP * sizeof(inst->STACK[0]));
+   memcpy(inst->GPR, state->GPR, NUM_GPRS);
+   inst->KEYS = 0;
+   for (u32 k = 0; k < NUM_KEYS; ++k)
+      inst->KEYS |= state->KEYS[k] << k;
+
+   inst->PC = state->PC;
+   inst->I = state->I;
+   inst->DELAY_TIMER = state->DELAY_TIMER;
+   inst->SOUND_TIMER = state->SOUND_TIMER;
+   inst->KEYS_DOWN = state->KEYS_DOWN;
+   inst->KEY_RELEASED = state->KEY_RELEASED;
+   inst->RNG = state->RNG;
+   inst->SHOULD_DRAW = state->SHOULD_DRAW;
+   inst->FAULT = fits ? state->FAULT : FAULT_STACK_FULL; // too deep for the compact stack
+   inst->WAITED = state->WAITED;
+   inst->POLL_PC = state->POLL_PC;
+   return fits && stored;
+}
+
+bool pool_run(Chip8Pool *pool, u32 id, Chip8Core core, u32 frames, u32 ipf, u16 keys_down, u8 key_released) {
+   Chip8 *state = &pool->scratch;
+   const CompactChip8 *inst = &pool->instances[id];
+   for (u32 p = 0; p < RAM_PAGES; ++p) {
+      if (pool->scratch_pages[p] != inst->pages[p])
+         memcpy(&state->RAM[p * RAM_PAGE], page_data(pool, inst, p), RAM_PAGE);
+   }
+   unpack_registers(inst, state);
+
+   bool drew = false;
+   for (u32 f = 0; f < frames && !state->FAULT; ++f) {
+      chip8_set_keypad(state, keys_down, f == 0 ? key_released : KEY_NONE); // a release lasts one frame
+      core(state, ipf);
+      drew |= state->SHOULD_DRAW;
+      if (state->FAULT)
+         break;
+      chip8_tick_timers(state);
+   }
+   state->SHOULD_DRAW = drew;
+
+   // written pages now match whatever the instance stored them to
+   if (pool_store(pool, id, state)) {
+      memcpy(pool->scratch_pages, inst->pages, sizeof(pool->scratch_pages));
+   } else {
+      for (u32 p = 0; p < RAM_PAGES; ++p)
+         pool->scratch_pages[p] = POOL_NONE; // scratch may hold writes that were not stored
+   }
+   return drew;
+}
+
+u64 pool_bytes(const Chip8Pool *pool) {
+   return sizeof(*pool) + (u64)pool->capacity * (sizeof(*pool->instances) + sizeof(*pool->free_ids)) +
+          (u64)pool->page_capacity * (RAM_PAGE + sizeof(*pool->free_pages));
+}
+
+static void unpack_registers(const CompactChip8 *inst, Chip8 *state) {
+   chip8_unpack_display(state, inst->DISPLAY);
+
+   memcpy(state->STACK.addresses, inst->STACK, inst->SP * sizeof(inst->STACK[0]));
+   state->STACK.head = inst->SP;
+   memcpy(state->GPR, inst->GPR, NUM_GPRS);
+   for (u32 k = 0; k < NUM_KEYS; ++k)
+      state->KEYS[k] = (inst->KEYS >> k) & 1;
+
+   state->PC = inst->PC;
+   state->I = inst->I;
+   state->DELAY_TIMER = inst->DELAY_TIMER;
+   state->SOUND_TIMER = inst->SOUND_TIMER;
+   state->KEYS_DOWN = inst->KEYS_DOWN;
+   state->KEY_RELEASED = inst->KEY_RELEASED;
+   state->RNG = inst->RNG;
+   state->SHOULD_DRAW = inst->SHOULD_DRAW;
+   state->FAULT = inst->FAULT;
+   state->WAITED = inst->WAITED;
+   state->POLL_PC = inst->POLL_PC;
+   state->DIRTY = 0;
+   state->DBG = NULL;
+}
+
+static void release_pages(Chip8Pool *pool, CompactChip8 *inst) {
+   for (u32 p = 0; p < RAM_PAGES; ++p) {
+      if (inst->pages[p] != POOL_SHARED_PAGE)
+         pool->free_pages[pool->num_free_pages++] = inst->pages[p] - 1;
+      inst->pages[p] = POOL_SHARED_PAGE;
+   }
+}
+
+static u32 alloc_page(Chip8Pool *pool) {
+   if (pool->num_free_pages > 0)
+      return pool->free_pages[--pool->num_free_pages];
+
+   // indices stay valid when the arena moves
+   if (pool->num_pages == pool->page_capacity) {
+      const u32 capacity = pool->page_capacity ? 2 * pool->page_capacity : MIN_PAGE_CAPACITY;
+      u8(*pages)[RAM_PAGE] = realloc(pool->pages, (u64)capacity * RAM_PAGE);
+      if (pages)
+         pool->pages = pages;
+      u32 *free_pages = pages ? realloc(pool->free_pages, (u64)capacity * sizeof(*free_pages)) : NULL;
+      if (!free_pages) {
+         printf("Failed to grow the page arena to %u pages\n", capacity);
+         return POOL_NONE; // the arena is left as it was
+      }
+      pool->free_pages = free_pages;
+      pool->page_capacity = capacity;
+   }
+   return pool->num_pages++;
+}
+
+static const u8 *page_data(const Chip8Pool *pool, const CompactChip8 *inst, u32 page) {
+   if (inst->pages[page] == POOL_SHARED_PAGE)
+      return &pool->image[page * RAM_PAGE];
+   return pool->pages[inst->pages[page] - 1];
+}
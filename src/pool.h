@@ -0,0 +1,83 @@
+#ifndef _POOL
+#define _POOL
+#include "chip8.h"
+
+#define POOL_STACK 16 // levels kept per instance, deeper calls fault
+#define POOL_NONE UINT32_MAX
+#define POOL_SHARED_PAGE 0 // page table entry for the shared image
+
+/*
+ * Dense storage for many instances of one ROM.
+ *
+ * A full Chip8 is over 6 KB, mostly a RAM copy that rarely differs from the loaded ROM, a bool per pixel and a deep
+ * stack. Compact instances keep registers, a 16 level stack, the display at one bit per pixel and a page table into
+ * RAM, about 400 bytes. RAM pages start out shared with the read-only power-on image (font and ROM) and get a private
+ * copy the first time the instance writes them (copy-on-write, found through Chip8.DIRTY), which is dropped again when
+ * a page is written back to its original contents.
+ *
+ * Instances live in one contiguous array allocated up front, private pages in a growing page arena. To run, an
+ * instance is unpacked into a scratch Chip8, stepped by any core, and packed back. Scratch RAM pages that already hold
+ * the right contents are not copied again, so running instances that mostly share pages costs little more than their
+ * registers and display.
+ */
+
+typedef struct CompactChip8 {
+   u32 pages[RAM_PAGES]; // POOL_SHARED_PAGE or 1 + index into the page arena
+   u8 DISPLAY[DISPLAY_PACKED];
+   u16 STACK[POOL_STACK];
+   u8 GPR[NUM_GPRS];
+   u16 PC;
+   u16 I;
+   u16 KEYS; // Chip8.KEYS, bit per key
+   u16 KEYS_DOWN;
+   u16 POLL_PC;
+   u32 RNG;
+   u8 SP;
+   u8 DELAY_TIMER;
+   u8 SOUND_TIMER;
+   u8 KEY_RELEASED;
+   u8 WAITED;
+   bool SHOULD_DRAW;
+   u8 FAULT;
+   bool used;
+} CompactChip8;
+
+typedef struct Chip8Pool {
+   u32 capacity;
+   u32 count; // instances in use
+   CompactChip8 *instances;
+   u32 *free_ids;
+   u32 num_free_ids;
+
+   u8 image[RAM_SIZE]; // power-on RAM shared by every instance
+
+   u8 (*pages)[RAM_PAGE]; // private pages, grown on demand
+   u32 num_pages;
+   u32 page_capacity;
+   u32 *free_pages;
+   u32 num_free_pages;
+
+   Chip8 scratch;                // unpacked instance for pool_run, nobody else's
+   u32 scratch_pages[RAM_PAGES]; // page table entries whose contents are in scratch RAM
+} Chip8Pool;
+
+Chip8Pool *pool_init(u32 capacity, void *app, u32 size);
+void pool_terminate(Chip8Pool **pool);
+
+// a power-on instance, POOL_NONE when the pool is full
+u32 pool_alloc(Chip8Pool *pool, u32 seed);
+void pool_free(Chip8Pool *pool, u32 id);
+void pool_reset(Chip8Pool *pool, u32 id, u32 seed); // back to power-on, its private pages are released
+
+// unpacks into state, which gets DIRTY cleared and no debugger
+void pool_load(const Chip8Pool *pool, u32 id, Chip8 *state);
+// packs state back, RAM pages not marked in DIRTY are taken as unchanged, false when its stack is too deep or a
+// written page could not be given memory
+bool pool_store(Chip8Pool *pool, u32 id, const Chip8 *state);
+
+// runs frames of ipf instructions through core with the keypad held, returns true if the instance drew
+bool pool_run(Chip8Pool *pool, u32 id, Chip8Core core, u32 frames, u32 ipf, u16 keys_down, u8 key_released);
+
+u64 pool_bytes(const Chip8Pool *pool); // memory held, instances and pages
+
+#endif
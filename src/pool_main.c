@@ -0,0 +1,117 @@
+#include "lockstep.h"
+#include "pool.h"
+#include "utils.h"
+
+/*
+ * Hosts many compact instances of one ROM (pool.h) and reports memory per instance and the cost of running them.
+ *
+ * Usage: poolbench [--instances N] [--frames F] [--ipf K] [--check N] rom
+ *   --check : also run the first N instances as full Chip8 instances and compare their state afterwards
+ */
+
+#define DEFAULT_INSTANCES 100000
+#define DEFAULT_FRAMES 60
+#define DEFAULT_IPF 12
+#define DEFAULT_CHECK 64
+
+static u16 random_keys(u32 *rng);
+
+int main(int argc, char **argv) {
+   u32 instances = DEFAULT_INSTANCES;
+   u32 frames = DEFAULT_FRAMES;
+   u32 ipf = DEFAULT_IPF;
+   u32 check = DEFAULT_CHECK;
+   const char *rom = NULL;
+
+   for (s32 i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+         instances = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+         frames = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc)
+         ipf = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc)
+         check = atoi(argv[++i]);
+      else
+         rom = argv[i];
+   }
+
+   if (!rom || instances == 0) {
+      printf("Usage: poolbench [--instances N] [--frames F] [--ipf K] [--check N] rom\n");
+      return 1;
+   }
+   check = check < instances ? check : instances;
+
+   u32 app_size = 0;
+   void *app = read_bin_file((char *)rom, &app_size);
+   if (!app) {
+      printf("MISSING %s\n", rom);
+      return 1;
+   }
+
+   Chip8Pool *pool = pool_init(instances, app, app_size);
+   if (!pool) {
+      free(app);
+      return 1;
+   }
+   Chip8 *full = calloc(check, sizeof(*full));
+   for (u32 k = 0; k < instances; ++k)
+      pool_alloc(pool, k + 1);
+   for (u32 k = 0; k < check; ++k) {
+      chip8_reset(&full[k]);
+      chip8_load_app(&full[k], app, app_size);
+      chip8_seed(&full[k], k + 1);
+   }
+   free(app);
+
+   // frame by frame over every instance, as a server hosting them would
+   u32 rng = 1;
+   u64 drew = 0;
+   const u64 time_beg = time_in_ns();
+   for (u32 f = 0; f < frames; ++f) {
+      for (u32 k = 0; k < instances; ++k)
+         drew += pool_run(pool, k, chip8_run_fused, 1, ipf, random_keys(&rng), KEY_NONE);
+   }
+   const u64 time_diff_ns = time_in_ns() - time_beg;
+
+   rng = 1;
+   for (u32 f = 0; f < frames; ++f) {
+      for (u32 k = 0; k < instances; ++k) {
+         const u16 keys = random_keys(&rng);
+         if (k < check) {
+            chip8_set_keypad(&full[k], keys, KEY_NONE);
+            chip8_run_fused(&full[k], ipf);
+            if (!full[k].FAULT)
+               chip8_tick_timers(&full[k]);
+         }
+      }
+   }
+
+   u32 mismatches = 0;
+   for (u32 k = 0; k < check; ++k) {
+      pool_load(pool, k, &pool->scratch);
+      if (!lockstep_equal(&pool->scratch, &full[k])) {
+         printf("MISMATCH instance %u (pool / full)\n", k);
+         lockstep_dump_diff(&pool->scratch, &full[k], stdout);
+         ++mismatches;
+      }
+   }
+
+   const u64 bytes = pool_bytes(pool);
+   printf("%u instances: %.0f bytes each (Chip8 is %zu), %u private pages\n", instances, (f64)bytes / instances,
+          sizeof(Chip8), pool->num_pages - pool->num_free_pages);
+   printf("%u frames: %.0f ns per instance frame, %llu draws\n", frames, (f64)time_diff_ns / frames / instances,
+          (unsigned long long)drew);
+   printf("%u / %u checked instances matched\n", check - mismatches, check);
+
+   free(full);
+   pool_terminate(&pool);
+   return mismatches ? 1 : 0;
+}
+
+static u16 random_keys(u32 *rng) {
+   *rng ^= *rng << 13;
+   *rng ^= *rng >> 17;
+   *rng ^= *rng << 5;
+   return *rng % 8 == 0 ? 1 << (*rng >> 8) % NUM_KEYS : 0;
+}
@@ -0,0 +1,160 @@
+#include "prof.h"
+#include "utils.h"
+
+static void record(ProfHistogram *hist, u64 ns);
+static u32 bucket_of(u64 ns);
+static u64 bucket_low(u32 bucket);
+static void print_hist(const ProfScope *scope, const ProfHistogram *hist, u64 root_ns, FILE *out);
+
+Profiler *prof_init() {
+   Profiler *prof = calloc(1, sizeof(*prof));
+   if (!prof) {
+      printf("Failed to allocate profiler\n");
+      return NULL;
+   }
+   prof->window_beg_ns = time_in_ns();
+   return prof;
+}
+
+void prof_terminate(Profiler **prof) {
+   free(*prof);
+   *prof = NULL;
+}
+
+u32 prof_scope(Profiler *prof, const char *name, s32 parent) {
+   assert(prof->num_scopes < PROF_MAX_SCOPES && parent < (s32)prof->num_scopes);
+   ProfScope *scope = &prof->scopes[prof->num_scopes];
+   scope->name = name;
+   scope->parent = parent;
+   scope->depth = parent == PROF_ROOT ? 0 : prof->scopes[parent].depth + 1;
+   assert(scope->depth < PROF_MAX_DEPTH);
+   return prof->num_scopes++;
+}
+
+void prof_begin(Profiler *prof, u32 scope) {
+   prof->scopes[scope].begin_ns = time_in_ns();
+}
+
+void prof_end(Profiler *prof, u32 scope) {
+   prof_value(prof, scope, time_in_ns() - prof->scopes[scope].begin_ns);
+}
+
+void prof_value(Profiler *prof, u32 scope, u64 ns) {
+   prof->scopes[scope].frame_ns += ns;
+   prof->scopes[scope].entered = true;
+}
+
+void prof_frame_end(Profiler *prof) {
+   for (u32 i = 0; i < prof->num_scopes; ++i) {
+      ProfScope *scope = &prof->scopes[i];
+      if (!scope->entered)
+         continue;
+      record(&scope->total, scope->frame_ns);
+      record(&scope->window, scope->frame_ns);
+      scope->frame_ns = 0;
+      scope->entered = false;
+   }
+   ++prof->frames;
+   ++prof->window_frames;
+}
+
+u64 prof_percentile(const ProfHistogram *hist, f64 p) {
+   if (!hist->count)
+      return 0;
+   const u64 rank = (u64)(p * (hist->count - 1));
+   u64 seen = 0;
+   for (u32 b = 0; b < PROF_BUCKETS; ++b) {
+      seen += hist->counts[b];
+      if (seen > rank) {
+         const u64 mid = (bucket_low(b) + bucket_low(b + 1)) / 2;
+         return mid < hist->max_ns ? mid : hist->max_ns;
+      }
+   }
+   return hist->max_ns;
+}
+
+void prof_window_reset(Profiler *prof) {
+   for (u32 i = 0; i < prof->num_scopes; ++i)
+      memset(&prof->scopes[i].window, 0, sizeof(prof->scopes[i].window));
+   prof->window_frames = 0;
+   prof->window_beg_ns = time_in_ns();
+}
+
+void prof_print(const Profiler *prof, bool window, FILE *out) {
+   const u64 frames = window ? prof->window_frames : prof->frames;
+   const f64 secs = window ? (time_in_ns() - prof->window_beg_ns) / 1e9 : 0;
+   if (window)
+      fprintf(out, "%llu frames in %.2f s\n", (unsigned long long)frames, secs);
+   else
+      fprintf(out, "%llu frames\n", (unsigned long long)frames);
+
+   fprintf(out, "%-24s %8s %10s %10s %10s %10s %6s\n", "scope (us)", "frames", "mean", "p50", "p99", "max", "share");
+   // shares are of the first root scope, the whole frame
+   const u64 root_ns = prof->num_scopes ? (window ? prof->scopes[0].window : prof->scopes[0].total).total_ns : 0;
+   for (u32 i = 0; i < prof->num_scopes; ++i) {
+      const ProfScope *scope = &prof->scopes[i];
+      print_hist(scope, window ? &scope->window : &scope->total, root_ns, out);
+   }
+}
+
+bool prof_export(const Profiler *prof, const char *path) {
+   FILE *out = fopen(path, "w");
+   if (!out) {
+      printf("Failed to open %s\n", path);
+      return false;
+   }
+   prof_print(prof, false, out);
+
+   fprintf(out, "\n# scope bucket_ns count\n");
+   for (u32 i = 0; i < prof->num_scopes; ++i) {
+      const ProfHistogram *hist = &prof->scopes[i].total;
+      for (u32 b = 0; b < PROF_BUCKETS; ++b)
+         if (hist->counts[b])
+            fprintf(out, "%s %llu %u\n", prof->scopes[i].name, (unsigned long long)bucket_low(b), hist->counts[b]);
+   }
+   const bool ok = !ferror(out);
+   if (fclose(out) != 0 || !ok) {
+      printf("Failed to write %s\n", path);
+      return false;
+   }
+   return true;
+}
+
+static void record(ProfHistogram *hist, u64 ns) {
+   ++hist->counts[bucket_of(ns)];
+   ++hist->count;
+   hist->total_ns += ns;
+   hist->max_ns = ns > hist->max_ns ? ns : hist->max_ns;
+}
+
+// exact below PROF_SUB_BUCKETS, then PROF_SUB_BUCKETS linear steps per power of two
+static u32 bucket_of(u64 ns) {
+   if (ns < PROF_SUB_BUCKETS)
+      return ns;
+   const u32 msb = 63 - __builtin_clzll(ns);
+   if (msb > PROF_MAX_BIT)
+      return PROF_BUCKETS - 1;
+   const u32 sub = (ns >> (msb - PROF_SUB_BITS)) & (PROF_SUB_BUCKETS - 1);
+   return (msb - PROF_SUB_BITS + 1) * PROF_SUB_BUCKETS + sub;
+}
+
+static u64 bucket_low(u32 bucket) {
+   if (bucket < PROF_SUB_BUCKETS)
+      return bucket;
+   const u32 msb = bucket / PROF_SUB_BUCKETS - 1 + PROF_SUB_BITS;
+   const u64 sub = bucket % PROF_SUB_BUCKETS;
+   return (PROF_SUB_BUCKETS + sub) << (msb - PROF_SUB_BITS);
+}
+
+static void print_hist(const ProfScope *scope, const ProfHistogram *hist, u64 root_ns, FILE *out) {
+   char name[32];
+   snprintf(name, sizeof(name), "%*s%s", scope->depth * 2, "", scope->name);
+   if (!hist->count) {
+      fprintf(out, "%-24s %8u\n", name, 0);
+      return;
+   }
+   const f64 share = root_ns ? 100.0 * hist->total_ns / root_ns : 0;
+   fprintf(out, "%-24s %8llu %10.1f %10.1f %10.1f %10.1f %5.1f%%\n", name, (unsigned long long)hist->count,
+           hist->total_ns / 1e3 / hist->count, prof_percentile(hist, 0.5) / 1e3, prof_percentile(hist, 0.99) / 1e3,
+           hist->max_ns / 1e3, share);
+}
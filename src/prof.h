@@ -0,0 +1,69 @@
+#ifndef _PROF
+#define _PROF
+#include "types.h"
+
+#define PROF_MAX_SCOPES 16
+#define PROF_MAX_DEPTH 4
+#define PROF_SUB_BITS 3 // 8 buckets per power of two, a bucket spans 12.5% of its value at most
+#define PROF_SUB_BUCKETS (1 << PROF_SUB_BITS)
+#define PROF_MAX_BIT 40 // durations up to 2^41 ns (36 min), longer ones land in the last bucket
+#define PROF_BUCKETS ((PROF_MAX_BIT - PROF_SUB_BITS + 2) * PROF_SUB_BUCKETS)
+#define PROF_ROOT -1
+
+/*
+ * Scoped timers for the host loop, on the monotonic ns clock.
+ *
+ * Scopes are registered once with a parent, which gives the report its hierarchy. A scope can be entered any number
+ * of times per frame, its time adds up and goes into its histogram once at prof_frame_end, so a frame that never
+ * entered it does not count. Value scopes take durations measured by the caller instead (sleep overshoot, lateness).
+ *
+ * Histograms have a fixed number of log-linear buckets, recording is a few integer ops. Each scope keeps one since the
+ * start and one since the last prof_window_reset, for a periodic overlay.
+ */
+
+typedef struct ProfHistogram {
+   u32 counts[PROF_BUCKETS];
+   u64 count;
+   u64 total_ns;
+   u64 max_ns;
+} ProfHistogram;
+
+typedef struct ProfScope {
+   const char *name;
+   s32 parent;
+   u32 depth;
+   u64 begin_ns;
+   u64 frame_ns; // this frame so far
+   bool entered; // this frame
+   ProfHistogram total;
+   ProfHistogram window;
+} ProfScope;
+
+typedef struct Profiler {
+   ProfScope scopes[PROF_MAX_SCOPES];
+   u32 num_scopes;
+   u64 frames;
+   u64 window_frames;
+   u64 window_beg_ns;
+} Profiler;
+
+Profiler *prof_init();
+void prof_terminate(Profiler **prof);
+
+// parent PROF_ROOT or an earlier scope, name must outlive the profiler
+u32 prof_scope(Profiler *prof, const char *name, s32 parent);
+
+void prof_begin(Profiler *prof, u32 scope);
+void prof_end(Profiler *prof, u32 scope);
+void prof_value(Profiler *prof, u32 scope, u64 ns); // adds a duration measured elsewhere to this frame
+void prof_frame_end(Profiler *prof);
+
+u64 prof_percentile(const ProfHistogram *hist, f64 p); // middle of the bucket holding it, p in [0, 1]
+void prof_window_reset(Profiler *prof);
+
+// one line per scope, indented by depth: frames entered, mean, p50, p99, max and share of the root scope's time
+void prof_print(const Profiler *prof, bool window, FILE *out);
+// prof_print of everything, then the non-empty buckets of every histogram, false when path cannot be written
+bool prof_export(const Profiler *prof, const char *path);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _QUIRKS
+#define _QUIRKS
+
+/*
+ * Select target hardware in CMakeLists
+ * CHIP8 / SCHIP / XOCHIP
+ *
+ * Note: Extensions for SCHIP and XOCHIP are unimplemented.
+ * Only quirks were fixed for the sake of the tests.
+ *
+ * Quirks:
+ *
+ * Q_VF_RESET
+ * Q_MEMORY
+ * Q_DISP_WAIT
+ * Q_CLIPPING
+ * Q_SHIFTING
+ * Q_JUMPING
+ */
+#ifdef CHIP8
+#define Q_VF_RESET
+#define Q_MEMORY
+#define Q_DISP_WAIT
+#define Q_CLIPPING
+
+#elif defined(SCHIP)
+#define Q_CLIPPING
+#define Q_SHIFTING
+#define Q_JUMPING
+
+#elif defined(XOCHIP)
+#define Q_MEMORY
+
+#endif
+
+#endif
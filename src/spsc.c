@@ -0,0 +1,41 @@
+#include "spsc.h"
+
+bool spsc_init(SpscQueue *q, u32 capacity, u32 item_size) {
+   if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+      return false;
+
+   memset(q, 0, sizeof(*q));
+   q->capacity = capacity;
+   q->item_size = item_size;
+   q->items = malloc((size_t)capacity * item_size);
+   return q->items != NULL;
+}
+
+void spsc_terminate(SpscQueue *q) {
+   free(q->items);
+   q->items = NULL;
+}
+
+bool spsc_push(SpscQueue *q, const void *item) {
+   const u32 head = q->head;
+   if (head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == q->capacity)
+      return false;
+
+   memcpy(&q->items[(size_t)(head & (q->capacity - 1)) * q->item_size], item, q->item_size);
+   __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE); // publishes the item
+   return true;
+}
+
+bool spsc_pop(SpscQueue *q, void *out_item) {
+   const u32 tail = q->tail;
+   if (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail)
+      return false;
+
+   memcpy(out_item, &q->items[(size_t)(tail & (q->capacity - 1)) * q->item_size], q->item_size);
+   __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE); // hands the slot back
+   return true;
+}
+
+u32 spsc_space(const SpscQueue *q) {
+   return q->capacity - (q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE));
+}
@@ -0,0 +1,26 @@
+#ifndef _SPSC
+#define _SPSC
+#include "types.h"
+
+#define SPSC_CACHE_LINE 64
+
+/*
+ * Bounded single-producer single-consumer queue of fixed-size items.
+ * Neither side locks or blocks: push fails when full and pop fails when empty.
+ */
+typedef struct SpscQueue {
+   u32 head __attribute__((aligned(SPSC_CACHE_LINE))); // next item written, owned by the producer
+   u32 tail __attribute__((aligned(SPSC_CACHE_LINE))); // next item read, owned by the consumer
+   u32 capacity __attribute__((aligned(SPSC_CACHE_LINE)));
+   u32 item_size;
+   u8 *items;
+} SpscQueue;
+
+bool spsc_init(SpscQueue *q, u32 capacity, u32 item_size); // capacity must be a power of two
+void spsc_terminate(SpscQueue *q);
+
+bool spsc_push(SpscQueue *q, const void *item); // producer, false when full
+bool spsc_pop(SpscQueue *q, void *out_item);    // consumer, false when empty
+u32 spsc_space(const SpscQueue *q);             // producer, items that can be pushed
+
+#endif
@@ -1,5 +1,7 @@
 #include "utils.h"
 
+#define HASH_PRIME 0x100000001B3ull
+
 void *read_bin_file(char *fname, u32 *out_size) {
    void *bin = NULL;
    FILE *file;
@@ -22,3 +24,18 @@ u64 time_in_ms() {
    gettimeofday(&tv, NULL);
    return (((long long)tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
 }
+
+u64 hash_bytes(u64 hash, const void *data, u32 size) {
+   const u8 *bytes = data;
+   for (u32 i = 0; i < size; ++i) {
+      hash ^= bytes[i];
+      hash *= HASH_PRIME;
+   }
+   return hash;
+}
+
+u64 time_in_ns() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ((u64)ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
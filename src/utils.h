@@ -12,5 +12,9 @@
 
 void *read_bin_file(char *fname, u32 *out_size);
 u64 time_in_ms();
+u64 time_in_ns(); // monotonic
+
+#define HASH_OFFSET 0xCBF29CE484222325ull // FNV-1a, where every hash starts
+u64 hash_bytes(u64 hash, const void *data, u32 size);
 
 #endif